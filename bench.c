@@ -0,0 +1,340 @@
+/* throughput of the sample kernels on synthetic waves and of med itself
+ * on a synthetic wave file, see make bench */
+#define _DEFAULT_SOURCE
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arg.h"
+#include "util.c"
+#include "dsp.c"
+#include "fft.c"
+
+char *argv0;
+
+static int repeats = 7;      /* -r, timed runs after one warming up */
+static FILE *out;            /* -o, the results as tab separated values */
+static char *med = "./med";  /* -m */
+static size_t wavemb = 64;   /* -n, megabytes of the wave file */
+static int channels = 2;     /* -c */
+static int bigendian;        /* -e */
+static char wave[] = "/tmp/medbench.XXXXXX";
+static double *t;            /* of each run */
+
+static double
+now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* throughput at the median and the 95th percentile of the times of the
+ * runs, each over n samples taking bytes */
+static void
+report(const char *name, double n, double bytes)
+{
+	double med, p95, x;
+	int i, j;
+
+	for (i = 1; i < repeats; ++i)
+		for (j = i; j > 0 && t[j - 1] > t[j]; --j)
+			x = t[j], t[j] = t[j - 1], t[j - 1] = x;
+	med = repeats % 2 ? t[repeats / 2] :
+		(t[repeats / 2 - 1] + t[repeats / 2]) / 2;
+	p95 = t[(int)ceil(0.95 * repeats) - 1];
+	printf("%-24s %9.1f %9.1f %9.1f %9.1f\n", name, n / med / 1e6,
+			n / p95 / 1e6, bytes / med / 1e6, bytes / p95 / 1e6);
+	if (out != NULL)
+		fprintf(out, "%s\t%.1f\t%.1f\t%.1f\t%.1f\n", name, n / med / 1e6,
+				n / p95 / 1e6, bytes / med / 1e6, bytes / p95 / 1e6);
+}
+
+/* one channel of secs seconds */
+static void
+benchresample(int from, int to, double secs)
+{
+	const Resampler *r;
+	size_t n = secs * from, nout, i;
+	int64_t a, e;
+	float *x, *y;
+	double t0;
+	char name[64];
+	int k;
+
+	if ((r = resampler(from, to)) == NULL)
+		die("malloc:");
+	nout = ((uint64_t)n * r->up + r->down - 1) / r->down;
+	resamplespan(r, 0, nout, &a, &e);
+	x = ecalloc(e - a, sizeof(float));
+	y = ecalloc(nout, sizeof(float));
+	for (i = 0; i < n; ++i)
+		x[i - a] = sin(i * 0.01);
+	for (k = -1; k < repeats; ++k) {
+		t0 = now();
+		resample(r, x, a, 0, nout, y, 1);
+		if (k >= 0)
+			t[k] = now() - t0;
+	}
+	snprintf(name, sizeof(name), "resample/%d/%d", from, to);
+	report(name, nout, sizeof(float) * nout);
+	free(x);
+	free(y);
+}
+
+/* one channel of secs seconds at 48 kHz through an impulse response of
+ * irsecs seconds */
+static void
+benchconv(double irsecs, double secs)
+{
+	size_t i, b, len = irsecs * 48000;
+	size_t n = (size_t)(secs * 48000) / CONVBLK * CONVBLK;
+	float *h, *x;
+	double t0;
+	char name[64];
+	int k;
+	Conv *c;
+
+	h = ecalloc(len, sizeof(float));
+	x = ecalloc(n, sizeof(float));
+	for (i = 0; i < len; ++i)
+		h[i] = exp(-(double)i / len * 8) * sin(i * 0.37);
+	for (k = -1; k < repeats; ++k) {
+		if ((c = convnew(h, len, CONVBLK)) == NULL)
+			die("malloc:");
+		for (b = 0; b < n; ++b)
+			x[b] = sin(b * 0.01);
+		t0 = now();
+		for (b = 0; b < n; b += CONVBLK)
+			convblock(c, x + b, x + b);
+		if (k >= 0)
+			t[k] = now() - t0;
+		convfree(c);
+	}
+	snprintf(name, sizeof(name), "conv/%lu", (unsigned long)len);
+	report(name, n, sizeof(float) * n);
+	free(h);
+	free(x);
+}
+
+/* secs seconds of ch channels at 48 kHz through a cascade of five
+ * biquads */
+static void
+benchbiquad(size_t ch, double secs)
+{
+	Biquad q[5];
+	size_t n = secs * 48000, i, g;
+	double *state, t0;
+	char name[64];
+	float *x;
+	int k;
+
+	biquaddesign(q, EqHigh, 80 / 48000.0, 0, M_SQRT1_2);
+	biquaddesign(q + 1, EqLowShelf, 200 / 48000.0, 4, M_SQRT1_2);
+	biquaddesign(q + 2, EqPeak, 1000 / 48000.0, -6, 1.4);
+	biquaddesign(q + 3, EqNotch, 60 / 48000.0, 0, 10);
+	biquaddesign(q + 4, EqHighShelf, 8000 / 48000.0, 3, M_SQRT1_2);
+	x = ecalloc(n * ch, sizeof(float));
+	state = ecalloc(2 * EQLANES * 5, sizeof(double));
+	for (i = 0; i < n * ch; ++i)
+		x[i] = sin(i * 0.01);
+	for (k = -1; k < repeats; ++k) {
+		t0 = now();
+		for (g = 0; g < ch; g += EQLANES)
+			biquad(x + g, n, ch, MIN(EQLANES, ch - g), q, 5, state);
+		if (k >= 0)
+			t[k] = now() - t0;
+	}
+	snprintf(name, sizeof(name), "biquad/%lu", (unsigned long)ch);
+	report(name, n * ch, sizeof(float) * n * ch);
+	free(x);
+	free(state);
+}
+
+/* a tile of n samples to a storage precision and back, passes times */
+static void
+benchprec(int prec, size_t n, size_t passes)
+{
+	size_t i, p;
+	double t0, *unpack;
+	uint16_t *c;
+	float *x;
+	int k;
+
+	x = ecalloc(n, sizeof(float));
+	c = ecalloc(n, sizeof(uint16_t));
+	unpack = ecalloc(repeats, sizeof(double));
+	for (i = 0; i < n; ++i)
+		x[i] = sin(i * 0.01);
+	for (k = -1; k < repeats; ++k) {
+		t0 = now();
+		for (p = 0; p < passes; ++p)
+			if (prec == PrecF16)
+				ftof16(c, x, n);
+			else
+				ftos16((int16_t *)c, x, n);
+		if (k >= 0)
+			t[k] = now() - t0;
+		t0 = now();
+		for (p = 0; p < passes; ++p)
+			if (prec == PrecF16)
+				f16tof(x, c, n);
+			else
+				s16tof(x, (int16_t *)c, n);
+		if (k >= 0)
+			unpack[k] = now() - t0;
+	}
+	report(prec == PrecF16 ? "pack/f16" : "pack/s16", n * passes,
+			sizeof(float) * n * passes);
+	memcpy(t, unpack, sizeof(double) * repeats);
+	report(prec == PrecF16 ? "unpack/f16" : "unpack/s16", n * passes,
+			sizeof(float) * n * passes);
+	free(x);
+	free(c);
+	free(unpack);
+}
+
+/* the wave file, a sine under a little noise in every channel */
+static void
+makewave(void)
+{
+	size_t i, n = (wavemb << 20) / sizeof(float), b;
+	union { float f; uint32_t u; } s;
+	uint32_t blk[4096];
+	FILE *fp;
+	int fd;
+
+	if ((fd = mkstemp(wave)) < 0 || (fp = fdopen(fd, "w")) == NULL)
+		die("mkstemp:");
+	srand(1);
+	for (i = 0; i < n; i += b) {
+		for (b = 0; b < 4096 && i + b < n; ++b) {
+			s.f = 0.5 * sin((i + b) / channels * 0.01) +
+				0.01 * (rand() / (double)RAND_MAX - 0.5);
+			blk[b] = bigendian ? __builtin_bswap32(s.u) : s.u;
+		}
+		if (fwrite(blk, sizeof(uint32_t), b, fp) != b)
+			die("fwrite:");
+	}
+	if (fclose(fp))
+		die("fclose:");
+}
+
+static void
+unlinkwave(const char *path)
+{
+	char pk[sizeof(wave) + 16];
+	snprintf(pk, sizeof(pk), "%s.pk", path);
+	unlink(path);
+	unlink(pk);
+}
+
+/* med on the wave file reading script as its shell input, %s in it is a
+ * scratch file; a run holds starting med and opening the wave, which
+ * for open is reading all of it as its peak sidecar goes before each */
+static void
+benchmed(const char *name, const char *script)
+{
+	char cmd[256], pk[sizeof(wave) + 8], scratch[sizeof(wave) + 8];
+	double t0;
+	FILE *p;
+	int k;
+
+	snprintf(pk, sizeof(pk), "%s.pk", wave);
+	snprintf(scratch, sizeof(scratch), "%s.out", wave);
+	snprintf(cmd, sizeof(cmd), "%s -f f32%s -c %d -s 48000 %s >/dev/null",
+			med, bigendian ? "be" : "le", channels, wave);
+	for (k = -1; k < repeats; ++k) {
+		if (!strcmp(name, "open"))
+			unlink(pk);
+		t0 = now();
+		if ((p = popen(cmd, "w")) == NULL)
+			die("popen:");
+		fprintf(p, script, scratch);
+		if (pclose(p))
+			die("%s failed on %s", med, name);
+		if (k >= 0)
+			t[k] = now() - t0;
+		unlinkwave(scratch);
+	}
+	report(name, (wavemb << 20) / sizeof(float), wavemb << 20);
+}
+
+static void
+usage(void)
+{
+	die("usage: %s [-r repeats] [-o results] [-m med] [-n megabytes] "
+			"[-c channels] [-e le|be]", argv0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	char *o = NULL, *e;
+
+	ARGBEGIN {
+	case 'r':
+		repeats = (int)strtol(ARGF(), NULL, 10); break;
+	case 'o':
+		o = ARGF(); break;
+	case 'm':
+		med = ARGF(); break;
+	case 'n':
+		wavemb = strtoul(ARGF(), NULL, 10); break;
+	case 'c':
+		channels = (int)strtol(ARGF(), NULL, 10); break;
+	case 'e':
+		if (strcmp(e = ARGF(), "le") && strcmp(e, "be"))
+			usage();
+		bigendian = *e == 'b';
+		break;
+	default:
+		usage(); break;
+	} ARGEND
+	if (repeats < 1 || !wavemb || channels < 1)
+		usage();
+	if (o != NULL && (out = fopen(o, "w")) == NULL)
+		die("fopen %s:", o);
+	t = ecalloc(repeats, sizeof(double));
+
+	dspinit();
+	printf("%-24s %19s %19s\n%-24s %9s %9s %9s %9s\n", "", "Msamples/s",
+			"MB/s", "", "median", "p95", "median", "p95");
+	if (out != NULL)
+		fprintf(out, "# %d runs, %luMB f32%s wave of %d channels\n"
+				"# name\tMsamples/s median\tp95\tMB/s median\tp95\n",
+				repeats, (unsigned long)wavemb, bigendian ? "be" : "le",
+				channels);
+	benchresample(44100, 48000, 60);
+	benchresample(48000, 44100, 60);
+	benchresample(48000, 96000, 60);
+	benchresample(96000, 48000, 60);
+	benchresample(44100, 48001, 60);
+	benchconv(0.05, 60);
+	benchconv(2, 60);
+	benchconv(10, 60);
+	benchbiquad(1, 60);
+	benchbiquad(2, 60);
+	benchbiquad(8, 60);
+	benchbiquad(12, 60);
+	benchprec(PrecF16, 1 << 14, 1024);
+	benchprec(PrecS16, 1 << 14, 1024);
+
+	makewave();
+	benchmed("open", "q\n");
+	benchmed("save", "s0\nw %s\nq\n");
+	benchmed("vol", "s0\n:vol/0.5\n:apply\nq\n");
+	benchmed("rev", "s0\n:rev\nq\n");
+	benchmed("dump", "s0\n:dump\nq\n");
+	unlinkwave(wave);
+
+	if (out != NULL && fclose(out))
+		die("fclose %s:", o);
+	free(t);
+	return 0;
+}
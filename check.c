@@ -0,0 +1,405 @@
+/* the vectorized kernels of dsp.c and codec.c against their scalar
+ * versions on random data, over every tail length, and a few runs of
+ * ./med through its shell, see make check */
+#define _DEFAULT_SOURCE
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util.c"
+#include "dsp.c"
+#include "codec.c"
+
+#define MAXN  64   /* lengths 0 to MAXN, twice the widest loop step */
+#define GUARD 16   /* elements past the end that must stay untouched */
+#define ROUNDS 64  /* of random data for each length */
+#define LENGTH(X) (sizeof X / sizeof X[0])
+
+static int failed, checked;
+static uint32_t seed = 1;
+
+static uint32_t
+rnd(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+/* floats from all over: random bits, nans and infinities among them,
+ * samples around full scale and halfway between integer steps */
+static float
+rndfloat(void)
+{
+	union { uint32_t u; float f; } x;
+	static const float special[] = { 0.0f, -0.0f, 1.0f, -1.0f, 0.5f,
+		SOFTKNEE, 1.0f + 0x1p-23f, 0x1p-15f, 1.5f / 32768, 65504.0f,
+		0x1p-25f, 0x1p-14f };
+
+	switch (rnd() % 8) {
+	case 0:
+		x.u = rnd();
+		return x.f;
+	case 1:
+		x.f = special[rnd() % LENGTH(special)];
+		return rnd() & 1 ? x.f : -x.f;
+	case 2:
+		return (rnd() & 1 ? 1 : -1) * (rnd() % 4 ? NAN : INFINITY);
+	case 3: /* on and between the steps of 8 to 24 bit formats */
+		return ((int32_t)rnd() >> (rnd() % 24 + 8)) * 0x1p-23f * 0.5f;
+	default:
+		return (rnd() / 2147483648.0f - 1) * 2;
+	}
+}
+
+static void
+fill(void *p, size_t bytes)
+{
+	unsigned char *b = p;
+	size_t i;
+	for (i = 0; i < bytes; ++i)
+		b[i] = rnd();
+}
+
+static void
+fillfloat(float *p, size_t n)
+{
+	size_t i;
+	for (i = 0; i < n; ++i)
+		p[i] = rndfloat();
+}
+
+static void
+report(const char *name, size_t n, const void *a, const void *b, size_t bytes)
+{
+	const unsigned char *x = a, *y = b;
+	size_t i;
+
+	++checked;
+	if (!memcmp(a, b, bytes))
+		return;
+	for (i = 0; x[i] == y[i]; ++i)
+		;
+	if (failed++ < 32)
+		printf("%s: length %lu differs at byte %lu of %lu\n", name,
+				(unsigned long)n, (unsigned long)i, (unsigned long)bytes);
+}
+
+static void
+checkswab32(const char *name,
+		void (*fn)(uint32_t *dst, const uint32_t *src, size_t n))
+{
+	uint32_t src[MAXN + GUARD], a[MAXN + GUARD], b[MAXN + GUARD];
+	size_t n, r;
+
+	for (n = 0; n <= MAXN; ++n)
+		for (r = 0; r < ROUNDS; ++r) {
+			fill(src, sizeof(src));
+			fill(a, sizeof(a));
+			memcpy(b, a, sizeof(a));
+			swab32_c(a, src, n);
+			fn(b, src, n);
+			report(name, n, a, b, sizeof(a));
+			/* in place */
+			memcpy(a, src, sizeof(a));
+			memcpy(b, src, sizeof(b));
+			swab32_c(a, a, n);
+			fn(b, b, n);
+			report(name, n, a, b, sizeof(a));
+		}
+}
+
+/* the peak goes in the slot after the guard, so a kernel that leaves
+ * it or the clip count alone shows up too */
+static void
+checkgain(const char *name, void (*fn)(float *p, size_t n, float g,
+		int limit, float *peak, size_t *clipped))
+{
+	static const float gains[] = { 1.0f, 0.5f, 3.0f, -2.0f, 1e30f, 0.0f };
+	float a[MAXN + GUARD + 1], b[MAXN + GUARD + 1];
+	size_t n, r, ca, cb;
+	int limit;
+
+	for (n = 0; n <= MAXN; ++n)
+		for (r = 0; r < ROUNDS; ++r)
+			for (limit = LimitNone; limit <= LimitSoft; ++limit) {
+				fillfloat(a, MAXN + GUARD);
+				memcpy(b, a, sizeof(a));
+				a[MAXN + GUARD] = b[MAXN + GUARD] = rnd() % 2 ? 0 : 0.75f;
+				ca = cb = r;
+				gain_c(a, n, gains[r % LENGTH(gains)], limit,
+						a + MAXN + GUARD, &ca);
+				fn(b, n, gains[r % LENGTH(gains)], limit,
+						b + MAXN + GUARD, &cb);
+				report(name, n, a, b, sizeof(a));
+				report(name, n, &ca, &cb, sizeof(ca));
+			}
+}
+
+static void
+checkf16(const char *name,
+		void (*to)(float *dst, const uint16_t *src, size_t n),
+		void (*from)(uint16_t *dst, const float *src, size_t n))
+{
+	uint16_t h[MAXN + GUARD], ha[MAXN + GUARD], hb[MAXN + GUARD];
+	float f[MAXN + GUARD], fa[MAXN + GUARD], fb[MAXN + GUARD];
+	size_t n, r;
+
+	for (n = 0; n <= MAXN; ++n)
+		for (r = 0; r < ROUNDS; ++r) {
+			fill(h, sizeof(h));
+			fill(fa, sizeof(fa));
+			memcpy(fb, fa, sizeof(fa));
+			f16tof_c(fa, h, n);
+			to(fb, h, n);
+			report(name, n, fa, fb, sizeof(fa));
+			fillfloat(f, MAXN + GUARD);
+			fill(ha, sizeof(ha));
+			memcpy(hb, ha, sizeof(ha));
+			ftof16_c(ha, f, n);
+			from(hb, f, n);
+			report(name, n, ha, hb, sizeof(ha));
+		}
+}
+
+static void
+checks16(const char *name,
+		void (*to)(float *dst, const int16_t *src, size_t n),
+		void (*from)(int16_t *dst, const float *src, size_t n))
+{
+	int16_t s[MAXN + GUARD], sa[MAXN + GUARD], sb[MAXN + GUARD];
+	float f[MAXN + GUARD], fa[MAXN + GUARD], fb[MAXN + GUARD];
+	size_t n, r;
+
+	for (n = 0; n <= MAXN; ++n)
+		for (r = 0; r < ROUNDS; ++r) {
+			fill(s, sizeof(s));
+			fill(fa, sizeof(fa));
+			memcpy(fb, fa, sizeof(fa));
+			s16tof_c(fa, s, n);
+			to(fb, s, n);
+			report(name, n, fa, fb, sizeof(fa));
+			fillfloat(f, MAXN + GUARD);
+			fill(sa, sizeof(sa));
+			memcpy(sb, sa, sizeof(sa));
+			ftos16_c(sa, f, n);
+			from(sb, f, n);
+			report(name, n, sa, sb, sizeof(sa));
+		}
+}
+
+/* every format both ways, with and without dither */
+static void
+checkcodec(const char *name,
+		void (*dec)(const Codec *c, float *dst, const void *src, size_t n),
+		void (*enc)(const Codec *c, void *dst, const float *src, size_t n,
+			uint32_t *dither))
+{
+	unsigned char e[8 * (MAXN + GUARD)], ea[8 * (MAXN + GUARD)],
+		eb[8 * (MAXN + GUARD)];
+	float f[MAXN + GUARD], fa[MAXN + GUARD], fb[MAXN + GUARD];
+	uint32_t da[DITHERLANES], db[DITHERLANES];
+	char what[64];
+	const Codec *c;
+	size_t n, r;
+
+	for (c = codecs; c->name != NULL; ++c) {
+		snprintf(what, sizeof(what), "%s %s", name, c->name);
+		for (n = 0; n <= MAXN; ++n)
+			for (r = 0; r < ROUNDS; ++r) {
+				fill(e, sizeof(e));
+				fill(fa, sizeof(fa));
+				memcpy(fb, fa, sizeof(fa));
+				decode_c(c, fa, e, n);
+				dec(c, fb, e, n);
+				report(what, n, fa, fb, sizeof(fa));
+				fillfloat(f, MAXN + GUARD);
+				fill(ea, sizeof(ea));
+				memcpy(eb, ea, sizeof(ea));
+				fill(da, sizeof(da));
+				memcpy(db, da, sizeof(da));
+				encode_c(c, ea, f, n, r % 2 ? da : NULL);
+				enc(c, eb, f, n, r % 2 ? db : NULL);
+				report(what, n, ea, eb, sizeof(ea));
+				report(what, n, da, db, sizeof(da));
+			}
+	}
+}
+
+#ifdef DSP_X86
+/* the filter kernels add in another order or fuse multiply adds, so
+ * they are held to a bound on the rounding instead of to the bits */
+static void
+near(const char *name, size_t n, const float *a, const float *b, size_t m,
+		const float *mag)
+{
+	size_t i;
+
+	++checked;
+	for (i = 0; i < m; ++i)
+		if (!(fabsf(a[i] - b[i]) <= 1e-5f * mag[i] + 1e-30f)) {
+			if (failed++ < 32)
+				printf("%s: length %lu off at %lu, %g and %g\n", name,
+						(unsigned long)n, (unsigned long)i, a[i], b[i]);
+			return;
+		}
+}
+
+static void
+checkdot(const char *name,
+		float (*fn)(const float *a, const float *b, size_t n))
+{
+	float a[MAXN + GUARD], b[MAXN + GUARD], ya, yb, mag;
+	size_t n, r, i;
+
+	for (n = 0; n <= MAXN; ++n)
+		for (r = 0; r < ROUNDS / 8; ++r) {
+			for (i = 0; i < MAXN + GUARD; ++i) {
+				a[i] = rnd() / 2147483648.0f - 1;
+				b[i] = rnd() / 2147483648.0f - 1;
+			}
+			for (mag = 0, i = 0; i < n; ++i)
+				mag += fabsf(a[i] * b[i]);
+			ya = dot_c(a, b, n);
+			yb = fn(a, b, n);
+			near(name, n, &ya, &yb, 1, &mag);
+		}
+}
+
+static void
+checkcmac(const char *name,
+		void (*fn)(float *yr, float *yi, const float *ar, const float *ai,
+			const float *br, const float *bi, size_t n))
+{
+	float x[4][MAXN + GUARD], ya[2][MAXN + GUARD], yb[2][MAXN + GUARD];
+	float mag[MAXN + GUARD];
+	size_t n, r, i, k;
+
+	for (i = 0; i < MAXN + GUARD; ++i)
+		mag[i] = 4;
+	for (n = 0; n <= MAXN; ++n)
+		for (r = 0; r < ROUNDS / 8; ++r) {
+			for (i = 0; i < MAXN + GUARD; ++i)
+				for (k = 0; k < 4; ++k)
+					x[k][i] = rnd() / 2147483648.0f - 1;
+			memcpy(ya, x, sizeof(ya));
+			memcpy(yb, x, sizeof(yb));
+			cmac_c(ya[0], ya[1], x[0], x[1], x[2], x[3], n);
+			fn(yb[0], yb[1], x[0], x[1], x[2], x[3], n);
+			near(name, n, ya[0], yb[0], MAXN + GUARD, mag);
+			near(name, n, ya[1], yb[1], MAXN + GUARD, mag);
+		}
+}
+
+/* a peak and a high pass with their state carried from round to round,
+ * so each round starts in the ringing of the one before */
+static void
+checkbiquad(const char *name,
+		void (*fn)(float *p, size_t n, size_t stride, size_t lanes,
+			const Biquad *q, size_t nq, double *state))
+{
+	float pa[EQLANES * MAXN], pb[EQLANES * MAXN], mag[EQLANES * MAXN];
+	double sa[2 * EQLANES * 2] = { 0 }, sb[2 * EQLANES * 2] = { 0 };
+	Biquad q[2];
+	size_t n, r, i, lanes;
+
+	biquaddesign(q, EqPeak, 0.02, 6, 1.4);
+	biquaddesign(q + 1, EqHigh, 0.001, 0, M_SQRT1_2);
+	for (i = 0; i < EQLANES * MAXN; ++i)
+		mag[i] = 8;
+	for (n = 0; n <= MAXN; ++n)
+		for (r = 0; r < ROUNDS / 8; ++r) {
+			lanes = r % EQLANES + 1;
+			for (i = 0; i < EQLANES * MAXN; ++i)
+				pa[i] = pb[i] = rnd() / 2147483648.0f - 1;
+			biquad_c(pa, n, EQLANES, lanes, q, 2, sa);
+			fn(pb, n, EQLANES, lanes, q, 2, sb);
+			near(name, n, pa, pb, EQLANES * MAXN, mag);
+			memcpy(sb, sa, sizeof(sa));
+		}
+}
+#endif
+
+/* a second of stereo at 44100 kept in precision prec by ./med, then
+ * resampled to rate: the wave stays in prec and holds only the bytes
+ * of the resampled frames */
+static void
+checkresample(const char *prec, size_t size, long rate)
+{
+	char path[] = "/tmp/medcheckXXXXXX", cmd[256], line[256], got[16] = "";
+	float buf[2 * 441];
+	unsigned long resident = 0, want = size * 2 * rate;
+	size_t i, k;
+	FILE *fp;
+	int fd;
+
+	if ((fd = mkstemp(path)) < 0 || (fp = fdopen(fd, "w")) == NULL)
+		die("mkstemp:");
+	for (k = 0; k < 100; ++k) {
+		for (i = 0; i < LENGTH(buf); ++i)
+			buf[i] = rnd() / 4294967296.0f - 0.5f;
+		fwrite(buf, sizeof(buf), 1, fp);
+	}
+	if (fclose(fp))
+		die("fclose:");
+	snprintf(cmd, sizeof(cmd), "printf 's0\\n:prec/%s\\n:resample/%ld\\n"
+			"i\\nq\\n' | ./med -f f32le -c 2 -s 44100 %s", prec, rate, path);
+	if ((fp = popen(cmd, "r")) == NULL)
+		die("popen:");
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		sscanf(line, " precision: %15[^,]", got);
+		sscanf(line, " resident: %lu", &resident);
+	}
+	pclose(fp);
+	snprintf(line, sizeof(line), "%s.pk", path);
+	unlink(path);
+	unlink(line);
+	++checked;
+	if (strcmp(got, prec) || resident != want)
+		if (failed++ < 32)
+			printf("resample %s to %ld: %s in %lu bytes, not %s in %lu\n",
+					prec, rate, got, resident, prec, want);
+}
+
+int
+main(void)
+{
+#ifdef DSP_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) {
+		checkswab32("swab32_sse2", swab32_sse2);
+		checkgain("gain_sse2", gain_sse2);
+		checks16("s16_sse2", s16tof_sse2, ftos16_sse2);
+		checkdot("dot_sse2", dot_sse2);
+		checkcmac("cmac_sse2", cmac_sse2);
+		checkbiquad("biquad_sse2", biquad_sse2);
+	}
+	if (__builtin_cpu_supports("ssse3")) {
+		checkswab32("swab32_ssse3", swab32_ssse3);
+		checkcodec("codec_ssse3", decode_ssse3, encode_ssse3);
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		checkswab32("swab32_avx2", swab32_avx2);
+		checkgain("gain_avx2", gain_avx2);
+		checks16("s16_avx2", s16tof_avx2, ftos16_avx2);
+		checkcodec("codec_avx2", decode_avx2, encode_avx2);
+	}
+	if (__builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c"))
+		checkf16("f16_f16c", f16tof_f16c, ftof16_f16c);
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		checkdot("dot_avx2", dot_avx2);
+		checkcmac("cmac_avx2", cmac_avx2);
+		checkbiquad("biquad_avx2", biquad_avx2);
+	}
+#endif
+	checkresample("s16", 2, 22050);
+	checkresample("f16", 2, 48000);
+	checkresample("f32", 4, 32000);
+	printf("%d of %d checks failed\n", failed, checked);
+	return failed != 0;
+}
@@ -0,0 +1,351 @@
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "codec.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DSP_X86
+#include <immintrin.h>
+#endif
+
+Codec codecs[] = {
+	/* name     size  big  type */
+	{ "f32le",  4,    0,   CodecFloat, decode_c, encode_c },
+	{ "f32be",  4,    1,   CodecFloat, decode_c, encode_c },
+	{ "f64le",  8,    0,   CodecFloat, decode_c, encode_c },
+	{ "f64be",  8,    1,   CodecFloat, decode_c, encode_c },
+	{ "s16le",  2,    0,   CodecInt,   decode_c, encode_c },
+	{ "s16be",  2,    1,   CodecInt,   decode_c, encode_c },
+	{ "s24le",  3,    0,   CodecInt,   decode_c, encode_c },
+	{ "s24be",  3,    1,   CodecInt,   decode_c, encode_c },
+	{ "s32le",  4,    0,   CodecInt,   decode_c, encode_c },
+	{ "s32be",  4,    1,   CodecInt,   decode_c, encode_c },
+	{ "u8",     1,    0,   CodecUint,  decode_c, encode_c },
+	{ NULL }
+};
+
+static uint32_t
+xorshift(uint32_t *x)
+{
+	*x ^= *x << 13;
+	*x ^= *x >> 17;
+	*x ^= *x << 5;
+	return *x;
+}
+
+const Codec *
+codecfind(const char *name)
+{
+	Codec *c;
+	for (c = codecs; c->name != NULL; ++c)
+		if (!strcmp(c->name, name))
+			return c;
+	return NULL;
+}
+
+int
+codecnative(const Codec *c)
+{
+	const union { uint16_t u; char b[2]; } host = { 1 };
+	return c->type == CodecFloat && c->size == sizeof(float) &&
+		c->endianness == !host.b[0];
+}
+
+/* dst may be equal to src for 4 byte formats */
+void
+decode_c(const Codec *c, float *dst, const void *src, size_t n)
+{
+	const unsigned char *s = src;
+	union { uint32_t u; float f; } f32;
+	union { uint64_t u; double f; } f64;
+	size_t i, k, bits = 8 * c->size;
+	float scale = c->type == CodecFloat ? 1 : 1.0f / ((uint32_t)1 << (bits - 1));
+	uint64_t v;
+
+	for (i = 0; i < n; ++i, s += c->size) {
+		for (v = 0, k = 0; k < c->size; ++k)
+			v |= (uint64_t)s[c->endianness ? c->size - 1 - k : k] << 8 * k;
+		if (c->type == CodecFloat && c->size == 4)
+			f32.u = v, dst[i] = f32.f;
+		else if (c->type == CodecFloat)
+			f64.u = v, dst[i] = f64.f;
+		else if (c->type == CodecUint)
+			dst[i] = ((int32_t)v - ((int32_t)1 << (bits - 1))) * scale;
+		else
+			dst[i] = ((int32_t)((uint32_t)v << (32 - bits)) >> (32 - bits)) * scale;
+	}
+}
+
+void
+encode_c(const Codec *c, void *dst, const float *src, size_t n,
+		uint32_t *dither)
+{
+	unsigned char *d = dst;
+	union { uint32_t u; float f; } f32;
+	union { uint64_t u; double f; } f64;
+	size_t i, k, bits = 8 * c->size;
+	int dith = dither != NULL && c->type != CodecFloat && c->size < 4;
+	float scale, lo, hi, y, r1, r2;
+	uint64_t v;
+
+	scale = c->type == CodecFloat ? 1 : (float)((uint32_t)1 << (bits - 1));
+	lo = -scale;
+	hi = c->size < 4 ? scale - 1 : 2147483520.0f; /* largest float below 2^31 */
+	for (i = 0; i < n; ++i, d += c->size) {
+		if (c->type == CodecFloat && c->size == 4) {
+			f32.f = src[i];
+			v = f32.u;
+		} else if (c->type == CodecFloat) {
+			f64.f = src[i];
+			v = f64.u;
+		} else {
+			y = src[i] * scale;
+			if (dith) { /* triangular, one step either way at most */
+				r1 = xorshift(dither + i % DITHERLANES) >> 8;
+				r2 = xorshift(dither + i % DITHERLANES) >> 8;
+				if (y != nearbyintf(y)) /* already on a step */
+					y += (r1 + r2) * 0x1p-24f - 1.0f;
+			}
+			/* nans are silence */
+			y = y < lo ? lo : y > hi ? hi : y == y ? y : 0;
+			v = (uint32_t)lrintf(y);
+			if (c->type == CodecUint)
+				v = (uint8_t)(v + 128);
+		}
+		for (k = 0; k < c->size; ++k)
+			d[c->endianness ? c->size - 1 - k : k] = v >> 8 * k;
+	}
+}
+
+#ifdef DSP_X86
+/* decoding moves the bytes of sample k to the top of lane k, encoding
+ * packs the low bytes of lane k back into sample k */
+static void
+codecmask(const Codec *c, char *m, int enc)
+{
+	size_t k, j, b;
+	memset(m, 0x80, 16);
+	for (k = 0; k < (c->size > 4 ? 2 : 4); ++k) {
+		for (j = 0; j < c->size; ++j) {
+			b = c->endianness ? c->size - 1 - j : j;
+			if (c->size > 4) /* doubles only swap */
+				m[c->size * k + j] = c->size * k + b;
+			else if (enc)
+				m[c->size * k + j] = 4 * k + b;
+			else
+				m[4 * k + 4 - c->size + b] = c->size * k + j;
+		}
+	}
+}
+
+__attribute__((target("ssse3"))) static void
+decode_ssse3(const Codec *c, float *dst, const void *src, size_t n)
+{
+	const unsigned char *s = src;
+	const __m128i x = _mm_set1_epi8(c->type == CodecUint ? (char)0x80 : 0);
+	const __m128 scale = _mm_set1_ps(c->type == CodecFloat ? 1 :
+			1.0f / ((uint32_t)1 << (8 * c->size - 1)));
+	const int sh = 32 - 8 * c->size;
+	char mb[16];
+	__m128i m, v;
+	size_t i;
+
+	if (c->size > 4) {
+		decode_c(c, dst, src, n);
+		return;
+	}
+	codecmask(c, mb, 0);
+	m = _mm_loadu_si128((const __m128i *)mb);
+	for (i = 0; c->size * i + 16 <= c->size * n; i += 4) {
+		v = _mm_loadu_si128((const __m128i *)(s + c->size * i));
+		v = _mm_shuffle_epi8(_mm_xor_si128(v, x), m);
+		if (c->type == CodecFloat)
+			_mm_storeu_ps(dst + i, _mm_castsi128_ps(v));
+		else
+			_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(
+					_mm_srai_epi32(v, sh)), scale));
+	}
+	decode_c(c, dst + i, s + c->size * i, n - i);
+}
+
+__attribute__((target("ssse3"))) static void
+encode_ssse3(const Codec *c, void *dst, const float *src, size_t n,
+		uint32_t *dither)
+{
+	unsigned char *d = dst;
+	const int dith = dither != NULL && c->type != CodecFloat && c->size < 4;
+	const float s = c->size > 4 ? 1 : (float)((uint32_t)1 << (8 * c->size - 1));
+	const __m128 scale = _mm_set1_ps(s), lo = _mm_set1_ps(-s),
+		hi = _mm_set1_ps(c->size < 4 ? s - 1 : 2147483520.0f),
+		step = _mm_set1_ps(0x1p-24f), one = _mm_set1_ps(1.0f);
+	const __m128i bias = _mm_set1_epi32(c->type == CodecUint ? 128 : 0);
+	__m128i m, st[2], r1, r2, v;
+	__m128 y;
+	char mb[16];
+	size_t i, k;
+
+	if (c->size > 4) {
+		encode_c(c, dst, src, n, dither);
+		return;
+	}
+	codecmask(c, mb, 1);
+	m = _mm_loadu_si128((const __m128i *)mb);
+	st[0] = st[1] = _mm_setzero_si128();
+	if (dith) {
+		st[0] = _mm_loadu_si128((const __m128i *)dither);
+		st[1] = _mm_loadu_si128((const __m128i *)(dither + 4));
+	}
+	/* eight samples at a time, for the eight dither lanes; each store
+	 * runs past its samples into the next ones, stored right after */
+	for (i = 0; c->size * (i + 4) + 16 <= c->size * n; i += 8) {
+		for (k = 0; k < 2; ++k) {
+			y = _mm_loadu_ps(src + i + 4 * k);
+			if (c->type == CodecFloat) {
+				v = _mm_castps_si128(y);
+			} else {
+				y = _mm_mul_ps(y, scale);
+				if (dith) {
+					st[k] = _mm_xor_si128(st[k], _mm_slli_epi32(st[k], 13));
+					st[k] = _mm_xor_si128(st[k], _mm_srli_epi32(st[k], 17));
+					r1 = st[k] = _mm_xor_si128(st[k], _mm_slli_epi32(st[k], 5));
+					st[k] = _mm_xor_si128(st[k], _mm_slli_epi32(st[k], 13));
+					st[k] = _mm_xor_si128(st[k], _mm_srli_epi32(st[k], 17));
+					r2 = st[k] = _mm_xor_si128(st[k], _mm_slli_epi32(st[k], 5));
+					y = _mm_add_ps(y, _mm_andnot_ps(_mm_cmpeq_ps(y,
+							_mm_cvtepi32_ps(_mm_cvtps_epi32(y))),
+							_mm_sub_ps(_mm_mul_ps(_mm_add_ps(
+							_mm_cvtepi32_ps(_mm_srli_epi32(r1, 8)),
+							_mm_cvtepi32_ps(_mm_srli_epi32(r2, 8))), step), one)));
+				}
+				y = _mm_and_ps(y, _mm_cmpord_ps(y, y));
+				y = _mm_max_ps(_mm_min_ps(y, hi), lo);
+				v = _mm_add_epi32(_mm_cvtps_epi32(y), bias);
+			}
+			_mm_storeu_si128((__m128i *)(d + c->size * (i + 4 * k)),
+					_mm_shuffle_epi8(v, m));
+		}
+	}
+	if (dith) {
+		_mm_storeu_si128((__m128i *)dither, st[0]);
+		_mm_storeu_si128((__m128i *)(dither + 4), st[1]);
+	}
+	encode_c(c, d + c->size * i, src + i, n - i, dither);
+}
+
+__attribute__((target("avx2"))) static void
+decode_avx2(const Codec *c, float *dst, const void *src, size_t n)
+{
+	const unsigned char *s = src;
+	const __m256i x = _mm256_set1_epi8(c->type == CodecUint ? (char)0x80 : 0);
+	const __m256 scale = _mm256_set1_ps(c->type == CodecFloat ? 1 :
+			1.0f / ((uint32_t)1 << (8 * c->size - 1)));
+	const __m128i sh = _mm_cvtsi32_si128(32 - 8 * c->size);
+	char mb[16];
+	__m256i m, v;
+	size_t i;
+
+	codecmask(c, mb, 0);
+	m = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)mb));
+	if (c->size == 8) {
+		for (i = 0; i + 4 <= n; i += 4) {
+			v = _mm256_loadu_si256((const __m256i *)(s + 8 * i));
+			if (c->endianness)
+				v = _mm256_shuffle_epi8(v, m);
+			_mm_storeu_ps(dst + i, _mm256_cvtpd_ps(_mm256_castsi256_pd(v)));
+		}
+		decode_c(c, dst + i, s + 8 * i, n - i);
+		return;
+	}
+	for (i = 0; c->size * (i + 4) + 16 <= c->size * n; i += 8) {
+		v = _mm256_inserti128_si256(_mm256_castsi128_si256(
+				_mm_loadu_si128((const __m128i *)(s + c->size * i))),
+				_mm_loadu_si128((const __m128i *)(s + c->size * (i + 4))), 1);
+		v = _mm256_shuffle_epi8(_mm256_xor_si256(v, x), m);
+		if (c->type == CodecFloat)
+			_mm256_storeu_ps(dst + i, _mm256_castsi256_ps(v));
+		else
+			_mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(
+					_mm256_sra_epi32(v, sh)), scale));
+	}
+	decode_ssse3(c, dst + i, s + c->size * i, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+encode_avx2(const Codec *c, void *dst, const float *src, size_t n,
+		uint32_t *dither)
+{
+	unsigned char *d = dst;
+	const int dith = dither != NULL && c->type != CodecFloat && c->size < 4;
+	const float s = c->size > 4 ? 1 : (float)((uint32_t)1 << (8 * c->size - 1));
+	const __m256 scale = _mm256_set1_ps(s), lo = _mm256_set1_ps(-s),
+		hi = _mm256_set1_ps(c->size < 4 ? s - 1 : 2147483520.0f),
+		step = _mm256_set1_ps(0x1p-24f), one = _mm256_set1_ps(1.0f);
+	const __m256i bias = _mm256_set1_epi32(c->type == CodecUint ? 128 : 0);
+	__m256i m, st, r1, r2, v;
+	__m256 y;
+	char mb[16];
+	size_t i;
+
+	codecmask(c, mb, 1);
+	m = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)mb));
+	if (c->size == 8) {
+		for (i = 0; i + 4 <= n; i += 4) {
+			v = _mm256_castpd_si256(_mm256_cvtps_pd(_mm_loadu_ps(src + i)));
+			if (c->endianness)
+				v = _mm256_shuffle_epi8(v, m);
+			_mm256_storeu_si256((__m256i *)(d + 8 * i), v);
+		}
+		encode_c(c, d + 8 * i, src + i, n - i, dither);
+		return;
+	}
+	st = dith ? _mm256_loadu_si256((const __m256i *)dither) : _mm256_setzero_si256();
+	for (i = 0; c->size * (i + 4) + 16 <= c->size * n; i += 8) {
+		y = _mm256_loadu_ps(src + i);
+		if (c->type == CodecFloat) {
+			v = _mm256_castps_si256(y);
+		} else {
+			y = _mm256_mul_ps(y, scale);
+			if (dith) {
+				st = _mm256_xor_si256(st, _mm256_slli_epi32(st, 13));
+				st = _mm256_xor_si256(st, _mm256_srli_epi32(st, 17));
+				r1 = st = _mm256_xor_si256(st, _mm256_slli_epi32(st, 5));
+				st = _mm256_xor_si256(st, _mm256_slli_epi32(st, 13));
+				st = _mm256_xor_si256(st, _mm256_srli_epi32(st, 17));
+				r2 = st = _mm256_xor_si256(st, _mm256_slli_epi32(st, 5));
+				y = _mm256_add_ps(y, _mm256_andnot_ps(_mm256_cmp_ps(y,
+						_mm256_cvtepi32_ps(_mm256_cvtps_epi32(y)), _CMP_EQ_OQ),
+						_mm256_sub_ps(_mm256_mul_ps(_mm256_add_ps(
+						_mm256_cvtepi32_ps(_mm256_srli_epi32(r1, 8)),
+						_mm256_cvtepi32_ps(_mm256_srli_epi32(r2, 8))), step), one)));
+			}
+			y = _mm256_and_ps(y, _mm256_cmp_ps(y, y, _CMP_ORD_Q));
+			y = _mm256_max_ps(_mm256_min_ps(y, hi), lo);
+			v = _mm256_add_epi32(_mm256_cvtps_epi32(y), bias);
+		}
+		v = _mm256_shuffle_epi8(v, m);
+		_mm_storeu_si128((__m128i *)(d + c->size * i), _mm256_castsi256_si128(v));
+		_mm_storeu_si128((__m128i *)(d + c->size * (i + 4)),
+				_mm256_extracti128_si256(v, 1));
+	}
+	if (dith)
+		_mm256_storeu_si256((__m256i *)dither, st);
+	encode_c(c, d + c->size * i, src + i, n - i, dither);
+}
+#endif
+
+void
+codecinit(void)
+{
+#ifdef DSP_X86
+	Codec *c;
+	__builtin_cpu_init();
+	for (c = codecs; c->name != NULL; ++c) {
+		if (__builtin_cpu_supports("avx2"))
+			c->decode = decode_avx2, c->encode = encode_avx2;
+		else if (__builtin_cpu_supports("ssse3"))
+			c->decode = decode_ssse3, c->encode = encode_ssse3;
+	}
+#endif
+}
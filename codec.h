@@ -0,0 +1,28 @@
+/* sample formats of wave files, kernels picked at startup by codecinit() */
+
+enum { CodecInt, CodecUint, CodecFloat }; /* codec types */
+
+#define DITHERLANES 8 /* dither generators, sample i uses i % DITHERLANES */
+
+typedef struct Codec Codec;
+struct Codec {
+	const char *name;
+	size_t size;     /* bytes per sample */
+	char endianness; /* 1 for big endian */
+	char type;
+	/* to and from n floats, the encoder adds tpdf dither to integer
+	 * formats narrower than 32 bits from the generators in dither,
+	 * leaving samples already on a step as they are */
+	void (*decode)(const Codec *c, float *dst, const void *src, size_t n);
+	void (*encode)(const Codec *c, void *dst, const float *src, size_t n,
+			uint32_t *dither);
+};
+
+extern Codec codecs[];
+
+const Codec *codecfind(const char *name);
+void codecinit(void);
+int codecnative(const Codec *c);
+void decode_c(const Codec *c, float *dst, const void *src, size_t n);
+void encode_c(const Codec *c, void *dst, const float *src, size_t n,
+		uint32_t *dither);
@@ -1 +1,20 @@
-static const char verbose = 1;
+static const char verbose = 0; /* the stats of each command on stderr */
+static const char syncwrites = 1; /* fsync saved waves before renaming them */
+static size_t membudget = 0; /* bytes of wave data kept in memory (-m takes
+                               * MiB), 0 keeps everything resident */
+static const size_t undolimit = 256 << 20; /* bytes kept for undo and redo */
+/* playback command, reading f32le at the sample rate and channels given */
+static const char *player = "ffplay -autoexit -nodisp -f f32le -ar %d "
+	"-channels %d -i - 2> /dev/null";
+static int nthreads = 0; /* workers for wave commands (-j), 0 for one per core */
+static const int iodepth = 4; /* waves read in at once as they open */
+
+#ifdef XVIEW
+static const char *fonts[] = { "monospace:size=10" };
+static const char *colors[][2] = {
+	/*               fg         bg        */
+	[SchemeNorm] = { "#bbbbbb", "#222222" },
+	[SchemeSel]  = { "#eeeeee", "#005577" },
+};
+static const unsigned int viewwidth = 1024, viewheight = 256;
+#endif
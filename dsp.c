@@ -0,0 +1,785 @@
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dsp.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DSP_X86
+#include <immintrin.h>
+#endif
+
+/* multiply by g, raising *peak to the largest magnitude and counting
+ * in *clipped the samples past full scale, both taken before limit is
+ * applied */
+void (*gain)(float *p, size_t n, float g, int limit,
+		float *peak, size_t *clipped) = gain_c;
+/* byte order swap of 32 bit words, dst may be equal to src */
+void (*swab32)(uint32_t *dst, const uint32_t *src, size_t n) = swab32_c;
+/* n frames every stride floats of p through a cascade of nq biquads,
+ * each of the first lanes floats of a frame a channel of its own; state
+ * holds 2 * EQLANES doubles a biquad and is carried from call to call,
+ * low corners need the precision */
+void (*biquad)(float *p, size_t n, size_t stride, size_t lanes,
+		const Biquad *q, size_t nq, double *state) = biquad_c;
+/* inner product of n floats */
+float (*dot)(const float *a, const float *b, size_t n) = dot_c;
+/* y += a * b over n complex numbers kept as real and imaginary parts */
+void (*cmac)(float *yr, float *yi, const float *ar, const float *ai,
+		const float *br, const float *bi, size_t n) = cmac_c;
+/* half floats to and from floats, rounded to the nearest even, past the
+ * range of halves to infinities */
+void (*f16tof)(float *dst, const uint16_t *src, size_t n) = f16tof_c;
+void (*ftof16)(uint16_t *dst, const float *src, size_t n) = ftof16_c;
+/* 16 bit integers over full scale to and from floats, rounded to the
+ * nearest even and clamped, nans to the positive end */
+void (*s16tof)(float *dst, const int16_t *src, size_t n) = s16tof_c;
+void (*ftos16)(int16_t *dst, const float *src, size_t n) = ftos16_c;
+
+static Resampler resamplers[8]; /* tables of the ratios used so far */
+
+void
+biquad_c(float *p, size_t n, size_t stride, size_t lanes, const Biquad *q,
+		size_t nq, double *state)
+{
+	double x, y, *s;
+	size_t i, k, c;
+	/* transposed direct form 2 */
+	for (i = 0; i < n; ++i, p += stride)
+		for (c = 0; c < lanes; ++c) {
+			x = p[c];
+			for (k = 0, s = state; k < nq; ++k, s += 2 * EQLANES) {
+				y = q[k].b0 * x + s[c];
+				s[c] = q[k].b1 * x + s[EQLANES + c] - q[k].a1 * y;
+				s[EQLANES + c] = q[k].b2 * x - q[k].a2 * y;
+				x = y;
+			}
+			p[c] = x;
+		}
+}
+
+/* the audio eq cookbook filters at f cycles per sample, db of gain for
+ * peaks and shelves */
+void
+biquaddesign(Biquad *q, int type, double f, double db, double Q)
+{
+	double w = 2 * M_PI * f, cw = cos(w), alpha = sin(w) / (2 * Q);
+	double A = pow(10, db / 40), sq = 2 * sqrt(A) * alpha;
+	double b0, b1, b2, a0, a1 = -2 * cw, a2;
+
+	a0 = 1 + alpha;
+	a2 = 1 - alpha;
+	switch (type) {
+	case EqLow:
+		b0 = b2 = (1 - cw) / 2;
+		b1 = 1 - cw;
+		break;
+	case EqHigh:
+		b0 = b2 = (1 + cw) / 2;
+		b1 = -(1 + cw);
+		break;
+	case EqBand:
+		b0 = alpha;
+		b1 = 0;
+		b2 = -alpha;
+		break;
+	case EqNotch:
+		b0 = b2 = 1;
+		b1 = -2 * cw;
+		break;
+	case EqPeak:
+		b0 = 1 + alpha * A;
+		b1 = -2 * cw;
+		b2 = 1 - alpha * A;
+		a0 = 1 + alpha / A;
+		a2 = 1 - alpha / A;
+		break;
+	case EqLowShelf:
+		b0 = A * ((A + 1) - (A - 1) * cw + sq);
+		b1 = 2 * A * ((A - 1) - (A + 1) * cw);
+		b2 = A * ((A + 1) - (A - 1) * cw - sq);
+		a0 = (A + 1) + (A - 1) * cw + sq;
+		a1 = -2 * ((A - 1) + (A + 1) * cw);
+		a2 = (A + 1) + (A - 1) * cw - sq;
+		break;
+	default: /* EqHighShelf */
+		b0 = A * ((A + 1) + (A - 1) * cw + sq);
+		b1 = -2 * A * ((A - 1) + (A + 1) * cw);
+		b2 = A * ((A + 1) + (A - 1) * cw - sq);
+		a0 = (A + 1) - (A - 1) * cw + sq;
+		a1 = 2 * ((A - 1) - (A + 1) * cw);
+		a2 = (A + 1) - (A - 1) * cw - sq;
+		break;
+	}
+	q->b0 = b0 / a0;
+	q->b1 = b1 / a0;
+	q->b2 = b2 / a0;
+	q->a1 = a1 / a0;
+	q->a2 = a2 / a0;
+}
+
+void
+cmac_c(float *yr, float *yi, const float *ar, const float *ai,
+		const float *br, const float *bi, size_t n)
+{
+	size_t i;
+	for (i = 0; i < n; ++i) {
+		yr[i] += ar[i] * br[i] - ai[i] * bi[i];
+		yi[i] += ar[i] * bi[i] + ai[i] * br[i];
+	}
+}
+
+void
+f16tof_c(float *dst, const uint16_t *src, size_t n)
+{
+	union { float f; uint32_t u; } x;
+	uint32_t s, e, m;
+	size_t i;
+
+	for (i = 0; i < n; ++i) {
+		s = (uint32_t)(src[i] & 0x8000) << 16;
+		e = src[i] >> 10 & 0x1f;
+		m = src[i] & 0x3ff;
+		if (e == 0) { /* zero or subnormal, m * 2^-24 */
+			x.f = ldexpf(m, -24);
+			x.u |= s;
+		} else if (e == 0x1f) {
+			x.u = s | 0x7f800000 | m << 13 | (m ? 0x400000 : 0);
+		} else {
+			x.u = s | (e + 112) << 23 | m << 13;
+		}
+		dst[i] = x.f;
+	}
+}
+
+void
+ftof16_c(uint16_t *dst, const float *src, size_t n)
+{
+	union { float f; uint32_t u; } x;
+	uint32_t s, m, r, half;
+	int e, shift;
+	size_t i;
+
+	for (i = 0; i < n; ++i) {
+		x.f = src[i];
+		s = x.u >> 16 & 0x8000;
+		e = (int)(x.u >> 23 & 0xff) - 112; /* rebiased */
+		m = x.u & 0x7fffff;
+		if (e == 0xff - 112) {
+			dst[i] = s | 0x7c00 | (m ? 0x200 | m >> 13 : 0);
+		} else if (e >= 0x1f) {
+			dst[i] = s | 0x7c00;
+		} else if (e <= 0) { /* subnormal, whole 24 bit significand */
+			if (e < -10) {
+				dst[i] = s;
+				continue;
+			}
+			m |= 0x800000;
+			shift = 14 - e;
+			r = m >> shift;
+			half = (uint32_t)1 << (shift - 1);
+			m &= ((uint32_t)1 << shift) - 1;
+			dst[i] = s | (r + (m > half || (m == half && (r & 1))));
+		} else { /* a carry out of the significand rounds up e */
+			r = (uint32_t)e << 10 | m >> 13;
+			m &= 0x1fff;
+			dst[i] = s | (r + (m > 0x1000 || (m == 0x1000 && (r & 1))));
+		}
+	}
+}
+
+void
+ftos16_c(int16_t *dst, const float *src, size_t n)
+{
+	float v;
+	size_t i;
+	for (i = 0; i < n; ++i) {
+		v = src[i] * 32768.0f;
+		v = v < 32767.0f ? v : 32767.0f;
+		v = v > -32768.0f ? v : -32768.0f;
+		dst[i] = (int16_t)lrintf(v);
+	}
+}
+
+float
+dot_c(const float *a, const float *b, size_t n)
+{
+	float s = 0;
+	size_t i;
+	for (i = 0; i < n; ++i)
+		s += a[i] * b[i];
+	return s;
+}
+
+void
+gain_c(float *p, size_t n, float g, int limit, float *peak, size_t *clipped)
+{
+	float y, a, u, pk = *peak;
+	size_t i, c = 0;
+	for (i = 0; i < n; ++i) {
+		y = p[i] * g;
+		a = y < 0 ? -y : y;
+		pk = a > pk ? a : pk;
+		c += a > 1.0f;
+		if (limit == LimitHard && a > 1.0f) {
+			y = y < 0 ? -1.0f : 1.0f;
+		} else if (limit == LimitSoft && a > SOFTKNEE) {
+			/* bends into full scale with a slope of one at the knee,
+			 * written so that overflow and infinities end on it */
+			u = (a - SOFTKNEE) / (1.0f - SOFTKNEE);
+			a = 1.0f - (1.0f - SOFTKNEE) / (1.0f + u);
+			y = y < 0 ? -a : a;
+		}
+		p[i] = y;
+	}
+	*peak = pk;
+	*clipped += c;
+}
+
+static double
+besseli0(double x)
+{
+	double s = 1, t = 1;
+	int k;
+	for (k = 1; t > 1e-12 * s; ++k) {
+		t *= x * x / (4.0 * k * k);
+		s += t;
+	}
+	return s;
+}
+
+/* taps of a linear phase kaiser windowed sinc, an odd count, cut at f1
+ * and f2 in cycles per sample; band filters are the difference of two
+ * low passes and high passes what a low pass leaves */
+float *
+firdesign(int type, double f1, double f2, size_t taps)
+{
+	const double beta = 8.0; /* about 80 dB down past the stopband */
+	double d, w, lo, hi;
+	float *h;
+	size_t j;
+
+	if ((h = malloc(sizeof(float) * taps)) == NULL)
+		return NULL;
+	lo = type == FirBand || type == FirStop ? f1 : 0;
+	hi = type == FirBand || type == FirStop ? f2 : f1;
+	for (j = 0; j < taps; ++j) {
+		d = (double)j - (double)(taps - 1) / 2;
+		w = 1 - d * d / ((double)(taps - 1) * (taps - 1) / 4);
+		w = w > 0 ? besseli0(beta * sqrt(w)) / besseli0(beta) : 0;
+		if (d == 0)
+			h[j] = w * 2 * (hi - lo);
+		else
+			h[j] = w * (sin(2 * M_PI * hi * d) - sin(2 * M_PI * lo * d)) /
+				(M_PI * d);
+		if (type == FirHigh || type == FirStop)
+			h[j] = (d == 0) - h[j];
+	}
+	return h;
+}
+
+/* n outputs from output k on, every stride floats of y, out of the input
+ * samples from resamplespan() in x, which starts at input sample xoff */
+void
+resample(const Resampler *r, const float *x, int64_t xoff, uint64_t k,
+		size_t n, float *y, size_t stride)
+{
+	const float *c;
+	uint64_t t;
+	double ph;
+	size_t i, row;
+	float f;
+
+	for (i = 0; i < n; ++i, ++k, y += stride) {
+		/* input sample t / up is under the middle of the row */
+		t = k * r->down;
+		c = x + (int64_t)(t / r->up) - (int64_t)r->taps / 2 + 1 - xoff;
+		if (r->phases == r->up) {
+			*y = dot(c, r->coef + r->taps * (t % r->up), r->taps);
+		} else {
+			/* between two tabulated phases */
+			ph = (double)(t % r->up) * r->phases / r->up;
+			row = ph;
+			f = ph - row;
+			*y = (1 - f) * dot(c, r->coef + r->taps * row, r->taps) +
+				f * dot(c, r->coef + r->taps * (row + 1), r->taps);
+		}
+	}
+}
+
+/* a kaiser windowed sinc with a phase for each fraction of an input sample
+ * an output can fall on, cut below the lower of the two rates so nothing
+ * folds back; tables are kept for the rest of the session */
+const Resampler *
+resampler(int from, int to)
+{
+	const double beta = 9.0; /* about 90 dB down past the stopband */
+	Resampler *r, *end = resamplers + sizeof(resamplers) / sizeof(*r);
+	double fc, ratio, d, w, sum;
+	int a = from, b = to, t, p;
+	size_t j;
+
+	while (b)
+		t = a % b, a = b, b = t;
+	for (r = resamplers; r < end && r->coef; ++r)
+		if (r->up == to / a && r->down == from / a)
+			return r;
+	if (r == end)
+		free((--r)->coef); /* the last one makes room */
+	r->up = to / a;
+	r->down = from / a;
+	r->phases = r->up <= RSPHASES ? r->up : RSPHASES;
+	ratio = r->up < r->down ? (double)r->up / r->down : 1;
+	r->taps = ((size_t)ceil(2 * RSZEROS / ratio) + 7) / 8 * 8;
+	/* the transition band fits between the passband and the new nyquist */
+	fc = ratio / 2 - 5.71 / r->taps / 2;
+	if ((r->coef = malloc(sizeof(float) * r->taps * (r->phases + 1))) == NULL)
+		return NULL;
+	for (p = 0; p <= r->phases; ++p) {
+		for (sum = 0, j = 0; j < r->taps; ++j) {
+			d = (double)j - (double)r->taps / 2 + 1 - (double)p / r->phases;
+			w = 1 - d * d / ((double)r->taps * r->taps / 4);
+			w = w > 0 ? besseli0(beta * sqrt(w)) / besseli0(beta) : 0;
+			w *= d == 0 ? 2 * fc : sin(2 * M_PI * fc * d) / (M_PI * d);
+			r->coef[r->taps * p + j] = w;
+			sum += w;
+		}
+		for (j = 0; j < r->taps; ++j) /* passes dc as it is */
+			r->coef[r->taps * p + j] /= sum;
+	}
+	return r;
+}
+
+/* input samples [*a, *e) read for n outputs from output k on */
+void
+resamplespan(const Resampler *r, uint64_t k, size_t n, int64_t *a, int64_t *e)
+{
+	*a = (int64_t)(k * r->down / r->up) - (int64_t)r->taps / 2 + 1;
+	*e = (int64_t)((k + n - 1) * r->down / r->up) + (int64_t)r->taps / 2 + 1;
+}
+
+void
+s16tof_c(float *dst, const int16_t *src, size_t n)
+{
+	size_t i;
+	for (i = 0; i < n; ++i)
+		dst[i] = src[i] * (1.0f / 32768);
+}
+
+void
+swab32_c(uint32_t *dst, const uint32_t *src, size_t n)
+{
+	size_t i;
+	for (i = 0; i < n; ++i)
+		dst[i] = (src[i] >> 24) | ((src[i] >> 8) & 0xff00) |
+			((src[i] << 8) & 0xff0000) | (src[i] << 24);
+}
+
+#ifdef DSP_X86
+/* the first m <= 4 floats of p */
+__attribute__((target("sse2"))) static inline __m128
+loadpart(const float *p, size_t m)
+{
+	switch (m) {
+	case 1:  return _mm_load_ss(p);
+	case 2:  return _mm_castpd_ps(_mm_load_sd((const double *)p));
+	case 3:  return _mm_setr_ps(p[0], p[1], p[2], 0);
+	default: return _mm_loadu_ps(p);
+	}
+}
+
+__attribute__((target("sse2"))) static inline void
+storepart(float *p, __m128 v, size_t m)
+{
+	switch (m) {
+	case 1:  _mm_store_ss(p, v); break;
+	case 3:  _mm_store_ss(p + 2, _mm_movehl_ps(v, v)); /* fallthrough */
+	case 2:  _mm_store_sd((double *)p, _mm_castps_pd(v)); break;
+	default: _mm_storeu_ps(p, v); break;
+	}
+}
+
+/* a frame in vectors of two lanes; the state of a filter ringing out is
+ * flushed to zero, denormals are slow */
+__attribute__((target("sse2"))) static void
+biquad_sse2(float *p, size_t n, size_t stride, size_t lanes, const Biquad *q,
+		size_t nq, double *state)
+{
+	__m128d x, y, s1[4 * EQMAX], s2[4 * EQMAX];
+	unsigned int csr = _mm_getcsr();
+	size_t i, k, h, m, nh = (lanes + 1) / 2;
+
+	_mm_setcsr(csr | 0x8040);
+	for (k = 0; k < nq; ++k)
+		for (h = 0; h < nh; ++h) {
+			s1[4 * k + h] = _mm_loadu_pd(state + 2 * EQLANES * k + 2 * h);
+			s2[4 * k + h] = _mm_loadu_pd(state + 2 * EQLANES * k + EQLANES +
+					2 * h);
+		}
+	for (i = 0; i < n; ++i, p += stride)
+		for (h = 0; h < nh; ++h) {
+			m = lanes - 2 * h < 2 ? lanes - 2 * h : 2;
+			x = _mm_cvtps_pd(loadpart(p + 2 * h, m));
+			for (k = 0; k < nq; ++k) {
+				y = _mm_add_pd(_mm_mul_pd(_mm_set1_pd(q[k].b0), x),
+						s1[4 * k + h]);
+				s1[4 * k + h] = _mm_sub_pd(_mm_add_pd(
+						_mm_mul_pd(_mm_set1_pd(q[k].b1), x), s2[4 * k + h]),
+						_mm_mul_pd(_mm_set1_pd(q[k].a1), y));
+				s2[4 * k + h] = _mm_sub_pd(_mm_mul_pd(_mm_set1_pd(q[k].b2), x),
+						_mm_mul_pd(_mm_set1_pd(q[k].a2), y));
+				x = y;
+			}
+			storepart(p + 2 * h, _mm_cvtpd_ps(x), m);
+		}
+	for (k = 0; k < nq; ++k)
+		for (h = 0; h < nh; ++h) {
+			_mm_storeu_pd(state + 2 * EQLANES * k + 2 * h, s1[4 * k + h]);
+			_mm_storeu_pd(state + 2 * EQLANES * k + EQLANES + 2 * h,
+					s2[4 * k + h]);
+		}
+	_mm_setcsr(csr);
+}
+
+/* a frame in vectors of four lanes */
+__attribute__((target("avx2,fma"))) static void
+biquad_avx2(float *p, size_t n, size_t stride, size_t lanes, const Biquad *q,
+		size_t nq, double *state)
+{
+	__m256d x, y, s1[2 * EQMAX], s2[2 * EQMAX];
+	unsigned int csr = _mm_getcsr();
+	size_t i, k, h, m, nh = (lanes + 3) / 4;
+
+	_mm_setcsr(csr | 0x8040);
+	for (k = 0; k < nq; ++k)
+		for (h = 0; h < nh; ++h) {
+			s1[2 * k + h] = _mm256_loadu_pd(state + 2 * EQLANES * k + 4 * h);
+			s2[2 * k + h] = _mm256_loadu_pd(state + 2 * EQLANES * k + EQLANES +
+					4 * h);
+		}
+	for (i = 0; i < n; ++i, p += stride)
+		for (h = 0; h < nh; ++h) {
+			m = lanes - 4 * h < 4 ? lanes - 4 * h : 4;
+			x = _mm256_cvtps_pd(loadpart(p + 4 * h, m));
+			for (k = 0; k < nq; ++k) {
+				y = _mm256_fmadd_pd(_mm256_broadcast_sd(&q[k].b0), x,
+						s1[2 * k + h]);
+				/* one multiply add on the path from y to the next y */
+				s1[2 * k + h] = _mm256_fnmadd_pd(_mm256_broadcast_sd(&q[k].a1),
+						y, _mm256_fmadd_pd(_mm256_broadcast_sd(&q[k].b1), x,
+						s2[2 * k + h]));
+				s2[2 * k + h] = _mm256_fnmadd_pd(_mm256_broadcast_sd(&q[k].a2),
+						y, _mm256_mul_pd(_mm256_broadcast_sd(&q[k].b2), x));
+				x = y;
+			}
+			storepart(p + 4 * h, _mm256_cvtpd_ps(x), m);
+		}
+	for (k = 0; k < nq; ++k)
+		for (h = 0; h < nh; ++h) {
+			_mm256_storeu_pd(state + 2 * EQLANES * k + 4 * h, s1[2 * k + h]);
+			_mm256_storeu_pd(state + 2 * EQLANES * k + EQLANES + 4 * h,
+					s2[2 * k + h]);
+		}
+	_mm_setcsr(csr);
+}
+
+__attribute__((target("sse2"))) static void
+cmac_sse2(float *yr, float *yi, const float *ar, const float *ai,
+		const float *br, const float *bi, size_t n)
+{
+	__m128 a, b, c, d;
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		a = _mm_loadu_ps(ar + i), b = _mm_loadu_ps(ai + i);
+		c = _mm_loadu_ps(br + i), d = _mm_loadu_ps(bi + i);
+		_mm_storeu_ps(yr + i, _mm_add_ps(_mm_loadu_ps(yr + i),
+				_mm_sub_ps(_mm_mul_ps(a, c), _mm_mul_ps(b, d))));
+		_mm_storeu_ps(yi + i, _mm_add_ps(_mm_loadu_ps(yi + i),
+				_mm_add_ps(_mm_mul_ps(a, d), _mm_mul_ps(b, c))));
+	}
+	cmac_c(yr + i, yi + i, ar + i, ai + i, br + i, bi + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) static void
+cmac_avx2(float *yr, float *yi, const float *ar, const float *ai,
+		const float *br, const float *bi, size_t n)
+{
+	__m256 a, b, c, d;
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		a = _mm256_loadu_ps(ar + i), b = _mm256_loadu_ps(ai + i);
+		c = _mm256_loadu_ps(br + i), d = _mm256_loadu_ps(bi + i);
+		_mm256_storeu_ps(yr + i, _mm256_fnmadd_ps(b, d,
+				_mm256_fmadd_ps(a, c, _mm256_loadu_ps(yr + i))));
+		_mm256_storeu_ps(yi + i, _mm256_fmadd_ps(b, c,
+				_mm256_fmadd_ps(a, d, _mm256_loadu_ps(yi + i))));
+	}
+	cmac_c(yr + i, yi + i, ar + i, ai + i, br + i, bi + i, n - i);
+}
+
+__attribute__((target("sse2"))) static float
+dot_sse2(const float *a, const float *b, size_t n)
+{
+	__m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+	float t[4];
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4),
+				_mm_loadu_ps(b + i + 4)));
+	}
+	_mm_storeu_ps(t, _mm_add_ps(s0, s1));
+	return t[0] + t[1] + t[2] + t[3] + dot_c(a + i, b + i, n - i);
+}
+
+/* two sums hide the latency of the fused multiply adds */
+__attribute__((target("avx2,fma"))) static float
+dot_avx2(const float *a, const float *b, size_t n)
+{
+	__m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+	__m128 h;
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+		s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8),
+				_mm256_loadu_ps(b + i + 8), s1);
+	}
+	if (i + 8 <= n) {
+		s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+		i += 8;
+	}
+	s0 = _mm256_add_ps(s0, s1);
+	h = _mm_add_ps(_mm256_castps256_ps128(s0), _mm256_extractf128_ps(s0, 1));
+	h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+	h = _mm_add_ss(h, _mm_shuffle_ps(h, h, 1));
+	return _mm_cvtss_f32(h) + dot_c(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx,f16c"))) static void
+f16tof_f16c(float *dst, const uint16_t *src, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(dst + i, _mm256_cvtph_ps(
+				_mm_loadu_si128((const __m128i *)(src + i))));
+	f16tof_c(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx,f16c"))) static void
+ftof16_f16c(uint16_t *dst, const float *src, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8)
+		_mm_storeu_si128((__m128i *)(dst + i), _mm256_cvtps_ph(
+				_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+	ftof16_c(dst + i, src + i, n - i);
+}
+
+__attribute__((target("sse2"))) static void
+ftos16_sse2(int16_t *dst, const float *src, size_t n)
+{
+	const __m128 k = _mm_set1_ps(32768.0f), hi = _mm_set1_ps(32767.0f),
+		lo = _mm_set1_ps(-32768.0f);
+	__m128i a, b;
+	size_t i;
+	/* min() takes its second operand for nans, as ftos16_c() does */
+	for (i = 0; i + 8 <= n; i += 8) {
+		a = _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(
+					_mm_mul_ps(_mm_loadu_ps(src + i), k), hi), lo));
+		b = _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(
+					_mm_mul_ps(_mm_loadu_ps(src + i + 4), k), hi), lo));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(a, b));
+	}
+	ftos16_c(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+ftos16_avx2(int16_t *dst, const float *src, size_t n)
+{
+	const __m256 k = _mm256_set1_ps(32768.0f), hi = _mm256_set1_ps(32767.0f),
+		lo = _mm256_set1_ps(-32768.0f);
+	__m256i a, b;
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		a = _mm256_cvtps_epi32(_mm256_max_ps(_mm256_min_ps(
+					_mm256_mul_ps(_mm256_loadu_ps(src + i), k), hi), lo));
+		b = _mm256_cvtps_epi32(_mm256_max_ps(_mm256_min_ps(
+					_mm256_mul_ps(_mm256_loadu_ps(src + i + 8), k), hi), lo));
+		/* the packs work within 128 bit lanes, the quarters are put
+		 * back in order after */
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_permute4x64_epi64(
+					_mm256_packs_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0)));
+	}
+	ftos16_sse2(dst + i, src + i, n - i);
+}
+
+__attribute__((target("sse2"))) static void
+gain_sse2(float *p, size_t n, float g, int limit, float *peak, size_t *clipped)
+{
+	const __m128 vg = _mm_set1_ps(g), sign = _mm_set1_ps(-0.0f),
+		one = _mm_set1_ps(1.0f), knee = _mm_set1_ps(SOFTKNEE),
+		range = _mm_set1_ps(1.0f - SOFTKNEE);
+	__m128 y, a, m, u, pk = _mm_setzero_ps();
+	float t[4];
+	size_t i, c = 0;
+
+	/* as gain_c(): max() takes its second operand when one is nan, so
+	 * nans pass through without raising the peak */
+	for (i = 0; i + 4 <= n; i += 4) {
+		y = _mm_mul_ps(_mm_loadu_ps(p + i), vg);
+		a = _mm_andnot_ps(sign, y);
+		pk = _mm_max_ps(a, pk);
+		m = _mm_cmpgt_ps(a, one);
+		c += __builtin_popcount(_mm_movemask_ps(m));
+		if (limit == LimitHard) {
+			y = _mm_or_ps(_mm_and_ps(m, _mm_or_ps(_mm_and_ps(sign, y), one)),
+					_mm_andnot_ps(m, y));
+		} else if (limit == LimitSoft) {
+			m = _mm_cmpgt_ps(a, knee);
+			u = _mm_div_ps(_mm_sub_ps(a, knee), range);
+			u = _mm_sub_ps(one, _mm_div_ps(range, _mm_add_ps(one, u)));
+			y = _mm_or_ps(_mm_and_ps(m, _mm_or_ps(_mm_and_ps(sign, y), u)),
+					_mm_andnot_ps(m, y));
+		}
+		_mm_storeu_ps(p + i, y);
+	}
+	_mm_storeu_ps(t, pk);
+	t[0] = t[0] > t[1] ? t[0] : t[1];
+	t[2] = t[2] > t[3] ? t[2] : t[3];
+	*peak = t[0] > *peak ? t[0] : *peak;
+	*peak = t[2] > *peak ? t[2] : *peak;
+	*clipped += c;
+	gain_c(p + i, n - i, g, limit, peak, clipped);
+}
+
+__attribute__((target("avx2"))) static void
+gain_avx2(float *p, size_t n, float g, int limit, float *peak, size_t *clipped)
+{
+	const __m256 vg = _mm256_set1_ps(g), sign = _mm256_set1_ps(-0.0f),
+		one = _mm256_set1_ps(1.0f), knee = _mm256_set1_ps(SOFTKNEE),
+		range = _mm256_set1_ps(1.0f - SOFTKNEE);
+	__m256 y, a, m, u, pk = _mm256_setzero_ps();
+	float t[8];
+	size_t i, j, c = 0;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		y = _mm256_mul_ps(_mm256_loadu_ps(p + i), vg);
+		a = _mm256_andnot_ps(sign, y);
+		pk = _mm256_max_ps(a, pk);
+		m = _mm256_cmp_ps(a, one, _CMP_GT_OQ);
+		c += __builtin_popcount(_mm256_movemask_ps(m));
+		if (limit == LimitHard) {
+			y = _mm256_blendv_ps(y, _mm256_or_ps(_mm256_and_ps(sign, y), one), m);
+		} else if (limit == LimitSoft) {
+			m = _mm256_cmp_ps(a, knee, _CMP_GT_OQ);
+			u = _mm256_div_ps(_mm256_sub_ps(a, knee), range);
+			u = _mm256_sub_ps(one, _mm256_div_ps(range, _mm256_add_ps(one, u)));
+			y = _mm256_blendv_ps(y, _mm256_or_ps(_mm256_and_ps(sign, y), u), m);
+		}
+		_mm256_storeu_ps(p + i, y);
+	}
+	_mm256_storeu_ps(t, pk);
+	for (j = 0; j < 8; ++j)
+		*peak = t[j] > *peak ? t[j] : *peak;
+	*clipped += c;
+	gain_sse2(p + i, n - i, g, limit, peak, clipped);
+}
+
+__attribute__((target("sse2"))) static void
+s16tof_sse2(float *dst, const int16_t *src, size_t n)
+{
+	const __m128 k = _mm_set1_ps(1.0f / 32768);
+	__m128i v;
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		v = _mm_loadu_si128((const __m128i *)(src + i));
+		/* each word to the top of a dword, shifted down with its sign */
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(
+					_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)), k));
+		_mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(
+					_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)), k));
+	}
+	s16tof_c(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+s16tof_avx2(float *dst, const int16_t *src, size_t n)
+{
+	const __m256 k = _mm256_set1_ps(1.0f / 32768);
+	size_t i;
+	for (i = 0; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(
+					_mm256_cvtepi16_epi32(_mm_loadu_si128(
+							(const __m128i *)(src + i)))), k));
+	s16tof_c(dst + i, src + i, n - i);
+}
+
+__attribute__((target("sse2"))) static void
+swab32_sse2(uint32_t *dst, const uint32_t *src, size_t n)
+{
+	size_t i;
+	__m128i v;
+	for (i = 0; i + 4 <= n; i += 4) {
+		v = _mm_loadu_si128((const __m128i *)(src + i));
+		/* swap bytes inside 16 bit words, then the words themselves */
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+		v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+		_mm_storeu_si128((__m128i *)(dst + i), v);
+	}
+	swab32_c(dst + i, src + i, n - i);
+}
+
+__attribute__((target("ssse3"))) static void
+swab32_ssse3(uint32_t *dst, const uint32_t *src, size_t n)
+{
+	const __m128i m = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+			11, 10, 9, 8, 15, 14, 13, 12);
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4)
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_shuffle_epi8(
+				_mm_loadu_si128((const __m128i *)(src + i)), m));
+	swab32_c(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+swab32_avx2(uint32_t *dst, const uint32_t *src, size_t n)
+{
+	const __m256i m = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+			11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7, 6, 5, 4,
+			11, 10, 9, 8, 15, 14, 13, 12);
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_shuffle_epi8(
+				_mm256_loadu_si256((const __m256i *)(src + i)), m));
+		_mm256_storeu_si256((__m256i *)(dst + i + 8), _mm256_shuffle_epi8(
+				_mm256_loadu_si256((const __m256i *)(src + i + 8)), m));
+	}
+	swab32_ssse3(dst + i, src + i, n - i);
+}
+#endif
+
+void
+dspinit(void)
+{
+#ifdef DSP_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		gain = gain_avx2, swab32 = swab32_avx2,
+			s16tof = s16tof_avx2, ftos16 = ftos16_avx2;
+	else if (__builtin_cpu_supports("ssse3"))
+		gain = gain_sse2, swab32 = swab32_ssse3,
+			s16tof = s16tof_sse2, ftos16 = ftos16_sse2;
+	else if (__builtin_cpu_supports("sse2"))
+		gain = gain_sse2, swab32 = swab32_sse2,
+			s16tof = s16tof_sse2, ftos16 = ftos16_sse2;
+	if (__builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c"))
+		f16tof = f16tof_f16c, ftof16 = ftof16_f16c;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		dot = dot_avx2, cmac = cmac_avx2, biquad = biquad_avx2;
+	else if (__builtin_cpu_supports("sse2"))
+		dot = dot_sse2, cmac = cmac_sse2, biquad = biquad_sse2;
+#endif
+}
@@ -0,0 +1,59 @@
+/* sample kernels, picked at startup by dspinit() */
+
+enum { LimitNone, LimitHard, LimitSoft };
+enum { FirLow, FirHigh, FirBand, FirStop }; /* firdesign() types */
+/* biquaddesign() types */
+enum { EqLow, EqHigh, EqBand, EqNotch, EqPeak, EqLowShelf, EqHighShelf };
+enum { PrecF32, PrecF16, PrecS16 }; /* precisions samples are stored in */
+
+#define PRECSIZE(p) ((p) == PrecF32 ? 4 : 2) /* bytes a sample takes */
+
+#define SOFTKNEE 0.9f  /* soft limiting starts here */
+#define EQLANES  8     /* channels a biquad() call filters at once */
+#define EQMAX    32    /* biquads a cascade may have */
+#define RSZEROS  64    /* zero crossings of the resampling filter each side */
+#define RSPHASES 1024  /* most filter phases tabulated, others interpolated */
+
+typedef struct {
+	double b0, b1, b2, a1, a2; /* over a0 */
+} Biquad;
+
+typedef struct {
+	int up, down; /* output and input samples of a period */
+	int phases;   /* rows of coef less one, up when that fits RSPHASES */
+	size_t taps;  /* per row, a multiple of 8 */
+	float *coef;
+} Resampler;
+
+extern void (*biquad)(float *p, size_t n, size_t stride, size_t lanes,
+		const Biquad *q, size_t nq, double *state);
+extern void (*gain)(float *p, size_t n, float g, int limit,
+		float *peak, size_t *clipped);
+extern void (*swab32)(uint32_t *dst, const uint32_t *src, size_t n);
+extern float (*dot)(const float *a, const float *b, size_t n);
+extern void (*cmac)(float *yr, float *yi, const float *ar, const float *ai,
+		const float *br, const float *bi, size_t n);
+extern void (*f16tof)(float *dst, const uint16_t *src, size_t n);
+extern void (*ftof16)(uint16_t *dst, const float *src, size_t n);
+extern void (*s16tof)(float *dst, const int16_t *src, size_t n);
+extern void (*ftos16)(int16_t *dst, const float *src, size_t n);
+
+void biquad_c(float *p, size_t n, size_t stride, size_t lanes, const Biquad *q,
+		size_t nq, double *state);
+void biquaddesign(Biquad *q, int type, double f, double db, double Q);
+void cmac_c(float *yr, float *yi, const float *ar, const float *ai,
+		const float *br, const float *bi, size_t n);
+float dot_c(const float *a, const float *b, size_t n);
+void dspinit(void);
+void f16tof_c(float *dst, const uint16_t *src, size_t n);
+float *firdesign(int type, double f1, double f2, size_t taps);
+void ftof16_c(uint16_t *dst, const float *src, size_t n);
+void ftos16_c(int16_t *dst, const float *src, size_t n);
+void gain_c(float *p, size_t n, float g, int limit, float *peak, size_t *clipped);
+void resample(const Resampler *r, const float *x, int64_t xoff, uint64_t k,
+		size_t n, float *y, size_t stride);
+const Resampler *resampler(int from, int to);
+void resamplespan(const Resampler *r, uint64_t k, size_t n, int64_t *a,
+		int64_t *e);
+void s16tof_c(float *dst, const int16_t *src, size_t n);
+void swab32_c(uint32_t *dst, const uint32_t *src, size_t n);
@@ -0,0 +1,205 @@
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fft.h"
+
+/*
+ * a real transform of n points is a complex one of n / 2 points over the
+ * even samples as real and the odd ones as imaginary parts, split into
+ * the spectra of both halves after; the complex one is an iterative
+ * radix 2 decimation in time on inputs loaded in bit reversed order
+ *
+ * the convolver keeps the spectra of the impulse response cut into
+ * blocks and of the input blocks seen last, each block out is the sum of
+ * their products transformed back, half of it overlapping the next one
+ */
+
+static void
+cfft(Fft *f, float *re, float *im, float sign)
+{
+	size_t m = f->n / 2, len, half, step, j, a, b;
+	float c, s, tr, ti;
+
+	for (len = 2; len <= m; len <<= 1) {
+		half = len / 2;
+		step = m / len;
+		for (j = 0; j < half; ++j) {
+			c = f->cs[j * step];
+			s = sign * f->sn[j * step];
+			for (a = j; a < m; a += len) {
+				b = a + half;
+				tr = re[b] * c - im[b] * s;
+				ti = re[b] * s + im[b] * c;
+				re[b] = re[a] - tr;
+				im[b] = im[a] - ti;
+				re[a] += tr;
+				im[a] += ti;
+			}
+		}
+	}
+}
+
+Fft *
+fftnew(size_t n)
+{
+	size_t m = n / 2, k, r, b, bits;
+	Fft *f;
+
+	if (n < 4 || (n & (n - 1)))
+		return NULL;
+	if ((f = calloc(1, sizeof(*f))) == NULL)
+		return NULL;
+	f->n = n;
+	f->rev = malloc(sizeof(size_t) * m);
+	f->cs = malloc(sizeof(float) * (3 * m + 2 * (m + 1)));
+	if (f->rev == NULL || f->cs == NULL) {
+		fftfree(f);
+		return NULL;
+	}
+	f->sn = f->cs + m / 2;
+	f->wr = f->sn + m / 2;
+	f->wi = f->wr + m + 1;
+	f->zr = f->wi + m + 1;
+	f->zi = f->zr + m;
+	for (bits = 0; ((size_t)1 << bits) < m; ++bits)
+		;
+	for (k = 0; k < m; ++k) {
+		for (r = 0, b = 0; b < bits; ++b)
+			r |= (k >> b & 1) << (bits - 1 - b);
+		f->rev[k] = r;
+	}
+	for (k = 0; k < m / 2; ++k) {
+		f->cs[k] = cos(2 * M_PI * k / m);
+		f->sn[k] = sin(2 * M_PI * k / m);
+	}
+	for (k = 0; k <= m; ++k) {
+		f->wr[k] = cos(2 * M_PI * k / n);
+		f->wi[k] = sin(2 * M_PI * k / n);
+	}
+	return f;
+}
+
+void
+fftfree(Fft *f)
+{
+	if (f == NULL)
+		return;
+	free(f->rev);
+	free(f->cs);
+	free(f);
+}
+
+void
+fftfwd(Fft *f, const float *x, float *re, float *im)
+{
+	size_t m = f->n / 2, k, j;
+	float er, ei, or, oi;
+
+	for (k = 0; k < m; ++k) {
+		f->zr[f->rev[k]] = x[2 * k];
+		f->zi[f->rev[k]] = x[2 * k + 1];
+	}
+	cfft(f, f->zr, f->zi, -1);
+	/* bin k of the even and of the odd samples from bins k and m - k */
+	for (k = 0; k <= m; ++k) {
+		j = k == 0 || k == m ? 0 : m - k;
+		er = (f->zr[k % m] + f->zr[j]) / 2;
+		ei = (f->zi[k % m] - f->zi[j]) / 2;
+		or = (f->zi[k % m] + f->zi[j]) / 2;
+		oi = (f->zr[j] - f->zr[k % m]) / 2;
+		re[k] = er + f->wr[k] * or + f->wi[k] * oi;
+		im[k] = ei + f->wr[k] * oi - f->wi[k] * or;
+	}
+}
+
+void
+fftinv(Fft *f, const float *re, const float *im, float *x)
+{
+	size_t m = f->n / 2, k;
+	float er, ei, dr, di;
+
+	for (k = 0; k < m; ++k) {
+		er = re[k] + re[m - k];
+		ei = im[k] - im[m - k];
+		dr = re[k] - re[m - k];
+		di = im[k] + im[m - k];
+		f->zr[f->rev[k]] = er - dr * f->wi[k] - di * f->wr[k];
+		f->zi[f->rev[k]] = ei + dr * f->wr[k] - di * f->wi[k];
+	}
+	cfft(f, f->zr, f->zi, 1);
+	for (k = 0; k < m; ++k) {
+		x[2 * k] = f->zr[k];
+		x[2 * k + 1] = f->zi[k];
+	}
+}
+
+Conv *
+convnew(const float *h, size_t len, size_t blk)
+{
+	size_t n = 2 * blk, p, k, seg;
+	Conv *c;
+	float g = 1.0f / n; /* undoes the scale of fftinv() */
+
+	if ((c = calloc(1, sizeof(*c))) == NULL)
+		return NULL;
+	c->blk = blk;
+	c->bins = blk + 1;
+	c->np = len > blk ? (len + blk - 1) / blk : 1;
+	if ((c->fft = fftnew(n)) == NULL ||
+			(c->hr = calloc(4 * c->np * c->bins + 2 * c->bins + blk + n,
+					sizeof(float))) == NULL) {
+		convfree(c);
+		return NULL;
+	}
+	c->hi = c->hr + c->np * c->bins;
+	c->xr = c->hi + c->np * c->bins;
+	c->xi = c->xr + c->np * c->bins;
+	c->yr = c->xi + c->np * c->bins;
+	c->yi = c->yr + c->bins;
+	c->tail = c->yi + c->bins;
+	c->work = c->tail + blk;
+	for (p = 0; p < c->np; ++p) {
+		seg = len - p * blk < blk ? len - p * blk : blk;
+		memset(c->work, 0, sizeof(float) * n);
+		for (k = 0; k < seg; ++k)
+			c->work[k] = h[p * blk + k] * g;
+		fftfwd(c->fft, c->work, c->hr + p * c->bins, c->hi + p * c->bins);
+	}
+	return c;
+}
+
+void
+convfree(Conv *c)
+{
+	if (c == NULL)
+		return;
+	fftfree(c->fft);
+	free(c->hr);
+	free(c);
+}
+
+void
+convblock(Conv *c, const float *x, float *y)
+{
+	size_t p, s, k;
+
+	memcpy(c->work, x, sizeof(float) * c->blk);
+	memset(c->work + c->blk, 0, sizeof(float) * c->blk);
+	fftfwd(c->fft, c->work, c->xr + c->head * c->bins,
+			c->xi + c->head * c->bins);
+	/* partition p of the response meets the input block p blocks back */
+	memset(c->yr, 0, sizeof(float) * 2 * c->bins);
+	for (p = 0; p < c->np; ++p) {
+		s = (c->head + c->np - p) % c->np;
+		cmac(c->yr, c->yi, c->xr + s * c->bins, c->xi + s * c->bins,
+				c->hr + p * c->bins, c->hi + p * c->bins, c->bins);
+	}
+	c->head = (c->head + 1) % c->np;
+	fftinv(c->fft, c->yr, c->yi, c->work);
+	for (k = 0; k < c->blk; ++k) {
+		y[k] = c->work[k] + c->tail[k];
+		c->tail[k] = c->work[c->blk + k];
+	}
+}
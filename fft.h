@@ -0,0 +1,37 @@
+/* real fourier transforms and uniformly partitioned convolution, the
+ * products of spectra are taken by cmac() of dsp.h */
+
+#define CONVBLK 1024 /* samples per partition of the impulse response */
+
+typedef struct {
+	size_t n;        /* real points, a power of two */
+	size_t *rev;     /* bit reversed order of the n / 2 point transform */
+	float *cs, *sn;  /* its twiddles */
+	float *wr, *wi;  /* twiddles splitting it into the real spectrum */
+	float *zr, *zi;  /* work */
+} Fft;
+
+/* spectra hold bins 0 to n / 2 with real and imaginary parts apart;
+ * fftinv() leaves its result scaled by n */
+Fft *fftnew(size_t n);
+void fftfree(Fft *f);
+void fftfwd(Fft *f, const float *x, float *re, float *im);
+void fftinv(Fft *f, const float *re, const float *im, float *x);
+
+typedef struct {
+	Fft *fft;
+	size_t blk, bins; /* samples per block, bins per spectrum */
+	size_t np, head;  /* partitions, slot of the newest input block */
+	float *hr, *hi;   /* spectra of the partitions */
+	float *xr, *xi;   /* of the last np input blocks */
+	float *yr, *yi;   /* of the block out */
+	float *tail;      /* overlap carried into the next block */
+	float *work;
+} Conv;
+
+/* a convolver with the len taps of h, each convblock() takes blk samples
+ * and returns the blk samples of the convolution under them, as if the
+ * input started with silence; one convolver streams one channel */
+Conv *convnew(const float *h, size_t len, size_t blk);
+void convfree(Conv *c);
+void convblock(Conv *c, const float *x, float *y);
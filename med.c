@@ -1,348 +1,3873 @@
+#define _DEFAULT_SOURCE
 #define _XOPEN_SOURCE 700
 
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef XVIEW
+#include <poll.h>
+#include <X11/keysym.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/Xft/Xft.h>
+
+#include "drw.h"
+#endif
 
 #include "arg.h"
 #include "util.c"
+#include "dsp.c"
+#include "codec.c"
+#include "pack.c"
+#include "fft.c"
+
+#define VERSION "0.1"
+#define LENGTH(X) (sizeof X / sizeof X[0])
+#define WRITEBUF (1 << 16) /* samples staged per write(2) */
+#define PLAYBUF  (1 << 14) /* samples per block streamed to the player */
+#define CHUNK    (1 << 20) /* samples per page of wave storage */
+#define TILE     (1 << 14) /* samples per tile handed to a worker */
+#define RSTILE   (1 << 12) /* frames of one channel a worker resamples */
+#define RSBATCH  (1 << 16) /* frames resampled between writes */
+#define LAYOUTBATCH (1 << 16) /* frames moved at once between layouts */
+#define CONVBATCH (1 << 16) /* frames convolved between writes, whole blocks */
+#define EQBATCH  (1 << 14) /* frames filtered between writes */
+#define FIRTAPS  2047      /* taps of a :fir/ filter not given a length */
+#define PEAKBLK  256       /* samples per level 0 peak, and peaks per peak above */
+#define PEAKLVLS 8
+#define PEAKMAGIC "medpeak2"
+#define VIEWPOLL 100       /* ms between redraws of a wave being loaded */
+#define SLABKEEP 16        /* free chunk slots of each size kept for reuse */
+#define SLABALIGN (2 << 20) /* of the slots, a huge page */
+#define STAGE    ((sizeof(float) + 8) * CHUNK) /* a chunk as floats and as read */
+#define COUNT(c, n) __atomic_fetch_add(&(c), (n), __ATOMIC_RELAXED)
+
+enum { Dirty = 1, Saved = 2, Loading = 4 }; /* chunk states */
+enum { Raw, Riff, Pack }; /* wave containers */
+enum { PeakFresh, PeakStale, PeakParent }; /* chunk peak states */
+enum { LoadPoll, LoadWait, LoadStop }; /* what loadfree() does to a loader */
+#ifdef XVIEW
+enum { SchemeNorm, SchemeSel, SchemeLast }; /* color schemes */
+enum { ViewPeaks = 1, ViewAll = 2 }; /* what a redraw has to recompute */
+#endif
+
+typedef struct {
+	float min, max, sq; /* sq is the sum of squares */
+} Peak;
+
+typedef struct {
+	double min, max, sq;
+} PeakSum;
+
+typedef struct {
+	char magic[8];
+	char codec[8];             /* name of the wave's format */
+	uint64_t size, n;          /* wave file size, level 0 peaks */
+	int64_t mtime, mtimensec;  /* of the wave file */
+} PeakHeader;
+
+typedef struct Buf Buf;
+struct Buf {
+	void **chunk;         /* resident chunks, NULL when paged out */
+	unsigned long *stamp; /* last use of each chunk */
+	int *pins;            /* workers using each chunk, never paged out */
+	char *state;
+	char prec;            /* samples are kept in, see dsp.h */
+	size_t len, nchunks;
+	float *map;           /* source mapping if it is in host byte order */
+	void *mapbase;        /* of the mapping, which starts on a page */
+	size_t mapsize;
+	off_t offset;         /* of the first sample in fd */
+	int fd, scratch;      /* source and scratch file, -1 if none */
+	const Codec *codec;   /* of the source */
+	uint64_t *seek;       /* of each block and the end if fd is packed */
+	size_t blk;           /* samples per packed block */
+	int channels;         /* a packed block is coded in */
+	Buf *parent;          /* copied on write from parent at poff */
+	size_t poff, unloaded;
+	int refs;             /* pieces and children using this buf */
+	Peak *peak[PEAKLVLS]; /* min/max/rms pyramid, built on demand */
+	size_t npeak[PEAKLVLS], nlevels;
+	size_t plo, phi;      /* level 0 peaks changed below the levels above */
+	char *pstate;
+};
+
+typedef struct {
+	Buf *buf;
+	size_t off, len; /* span of buf */
+	size_t pos;      /* of the span in the wave */
+} Piece;
+
+typedef struct {
+	size_t l, r; /* samples of the wave it covers */
+	float g;     /* and limiter of a gain, the only point-wise edit */
+	int limit;
+} Op;
+
+typedef struct {
+	Piece *piece;
+	size_t npieces, wsize, leftSelection, rightSelection;
+	int sampleRate;
+	char planar, prec;
+	Op *ops;
+	size_t nops;
+	size_t cost;         /* bytes copied on write while it was newest */
+	unsigned long stamp; /* oldest entries are dropped first */
+	char modificated;
+} Snap;
+
+typedef struct {
+	Buf *b;              /* a ref of its own, so edits copy on write */
+	char *filename;
+	const Codec *codec;
+	struct stat st;      /* of the file when it was opened */
+	char store;          /* leaves the peaks in a sidecar when done */
+	size_t done;         /* chunks scanned, atomic */
+	char stop;           /* atomic */
+	char finished;       /* under loads.lock */
+} Loader;
+
+typedef struct {
+	char *name;
+	Piece *piece;    /* spans of immutable buffers making up the wave */
+	size_t npieces;
+	size_t wsize, leftSelection, rightSelection;
+	int sampleRate, channels;
+	const Codec *codec; /* written back in this format by default */
+	char head;          /* and in this container */
+	char planar;        /* channels one after another, see waveplane() */
+	char prec;          /* new buffers keep samples in */
+	char modificated;
+	Op *ops;            /* edits not applied yet, see waveapply() */
+	size_t nops;
+	Snap *undo, *redo;
+	size_t nundo, nredo;
+	Loader *load;       /* scanning the wave as it opens, or NULL */
+} Wave;
+
+typedef struct {
+	const Codec *codec;
+	int rate, channels;
+	off_t offset;      /* of the samples, or the seek table if packed */
+	uint64_t size;     /* bytes of samples */
+	size_t blk;        /* samples per packed block */
+} Header;
+
+typedef struct {
+	Buf *b;
+	size_t ci;
+	float *tile;   /* lent for the samples of a compact chunk, or NULL */
+	void *c;       /* that chunk */
+	size_t off, n; /* of the tile in it */
+	char write;
+} Pin;
+
+typedef struct {
+	char cmd[32];
+	double wall, cpu;     /* seconds */
+	size_t touched;       /* bytes of samples lent by wavepin() */
+	size_t read, written; /* bytes of files, pipes and scratch */
+	size_t allocs;        /* slots, tiles and scratch blocks allocated */
+	long faults;          /* major page faults, mapped waves read in */
+	long rss;             /* kB of peak resident set, in a record grown by */
+} Stat;
+
+static void *arenaget(size_t nmemb, size_t size);
+static void arenareset(void);
+static void *bufchunk(Buf *b, size_t ci, char write, char pin);
+static void bufget(Buf *b, size_t pos, size_t n, void *dst);
+static void *bufload(Buf *b, size_t ci, char write);
+static Buf *bufnew(size_t len, int fd, off_t offset, const Codec *codec);
+static void bufpack(Buf *b, void *c, size_t off, size_t n, const float *t);
+static void bufpageout(Buf *b, size_t ci);
+static size_t bufread(Buf *b, size_t ci, void *c, size_t n, char saved,
+		unsigned char *stage);
+static size_t bufsource(Buf *b, size_t ci, float *c, size_t n,
+		unsigned char *stage);
+static void bufpeakalloc(Buf *b);
+static void bufpeakchunk(void *arg, size_t i);
+static void bufpeakfresh(Buf *b, size_t a, size_t e);
+static void bufpeaklevel(Buf *b, size_t k, size_t ba, size_t be, PeakSum *s);
+static void bufpeakraw(Buf *b, size_t a, size_t e, PeakSum *s);
+static void bufpeakup(Buf *b);
+static void bufpeaks(Buf *b, size_t a, size_t e, PeakSum *s);
+static void bufput(Buf *b);
+static void bufrelease(Buf *b);
+static const float *bufunpack(Buf *b, const void *c, size_t off, size_t n,
+		float *t);
+static void bufunpin(Buf *b, size_t ci);
+static void applywave(Wave *waves, size_t waven, Wave *wave);
+static void changewavselection(Wave *wave, char isRight, char *l);
+static void docommand(Wave **waves, size_t *waven, int *selwav, char *l);
+static void editwave(Wave **waves, size_t *waven, char *wname);
+static void freewave(Wave *wave);
+static uint64_t getle(const unsigned char *p, int n);
+static void histcharge(Wave *waves, size_t waven, Wave *wave, size_t bytes);
+static void histfree(Snap *s, size_t n);
+static char hostendianness(void);
+static void loadfree(Wave *wave, int how);
+static int loadprogress(Loader *l);
+static void loadrun(Loader *l);
+static Loader *loadstart(Buf *b, char *filename, const Codec *codec,
+		struct stat *st, char store);
+static void *loadthread(void *unused);
+static void newwave(Wave **waves, size_t *waven, char *wname);
+static void packblock(void *arg, size_t i);
+static Buf *packsame(Wave *wave, size_t pos, size_t n);
+static void packsave(int fd, Wave *wave, char *filename, Peak *pk);
+static void playwave(Wave wave);
+static void *playwriter(void *arg);
+static void poolinit(int n);
+static int precfind(const char *name);
+static void poolrun(void (*fn)(void *arg, size_t i), void *arg, size_t n);
+static void *poolworker(void *unused);
+static void piececow(Piece *p);
+static size_t piecefind(Wave *wave, size_t pos);
+static void peakadd(PeakSum *s, const Peak *p);
+static int peakload(Buf *b, char *filename, struct stat *st);
+static void peakscan(const float *p, size_t n, Peak *pk);
+static void peakstore(const Peak *p, size_t n, char *filename,
+		const Codec *codec);
+static void pieceinsert(Wave *wave, size_t i, const Piece *p, size_t n);
+static void pieceremove(Wave *wave, size_t i, size_t n);
+static size_t piecesplit(Wave *wave, size_t pos);
+static void printstats(void);
+static void printwaveinfo(Wave wave);
+static void putle(unsigned char *p, uint64_t v, int n);
+static void printwavelist(Wave *waves, size_t waven);
+static size_t readall(int fd, void *buf, size_t n, off_t off);
+static int readheader(int fd, off_t fsize, Header *h);
+static int readwave(Wave *ret, char *filename, const Codec *codec,
+		int sampleRate, int channels, char prec, char async);
+static size_t riffheader(unsigned char *h, const Codec *codec, int rate,
+		int channels, uint64_t size);
+static void savewave(char *filename, Wave wave, const Codec *codec,
+		char sidecar);
+static void selectwave(Wave *waves, size_t waven, int *selwav, char *l);
+static void shell(Wave **waves, size_t *waven);
+static void snaprestore(Snap *s, Wave *wave);
+static void *slabget(int prec);
+static void slabput(int prec, void *c);
+static void snaptake(Snap *s, Wave *wave);
+static void statrecord(const char *cmd, const Stat *a, const Stat *b);
+static void statsample(Stat *s);
+static void waveapply(Wave *wave);
+static void waveapplykern(void *arg, float *p, size_t n);
+static void waveblank(Wave *wave, size_t n);
+static void waveconv(Wave *wave, Conv **cv, size_t delay);
+static void waveconvfile(Wave *wave, char *l);
+static void waveconvtile(void *arg, size_t i);
+static void wavecopy(Wave *wave);
+static void wavecut(Wave *wave);
+static void wavedelete(Wave *wave);
+static void wavedump(Wave wave);
+static void waveeq(Wave *wave, char *l);
+static void waveeqtile(void *arg, size_t i);
+static void wavefir(Wave *wave, char *l);
+static void waveget(Wave *wave, size_t pos, size_t n, float *dst);
+static int wavelayout(Wave *wave, char planar, char prec);
+static Wave *waveslot(Wave **waves, size_t *waven);
+static void wavemap(Wave *wave, size_t l, size_t r,
+		void (*kern)(void *arg, float *p, size_t n), void *arg);
+static void wavemaptile(void *arg, size_t i);
+static void wavepaste(Wave *wave);
+static float *wavepin(Wave *wave, size_t pos, size_t *n, char write,
+		Pin *pin);
+static void waveprecision(Wave *wave, char *l);
+static void waveprivate(Wave *wave, size_t l, size_t r);
+static void waveput(Wave *wave, size_t pos, size_t n, const float *src);
+static void wavepeaks(Wave *wave, size_t l, size_t r, PeakSum *s, char coarse);
+static void wavepeakspan(Wave *wave, size_t l, size_t r, PeakSum *s,
+		char coarse);
+static size_t waveplane(Wave *wave, size_t c, size_t pos);
+static void waveplanar(Wave *wave, char planar);
+static void waverange(Wave *wave, size_t *l, size_t *r);
+static void waveread(Wave *wave, size_t pos, size_t n, float *dst);
+static void waveredo(Wave *wave);
+static size_t waveresident(Wave *wave);
+static void waveresample(Wave *wave, char *l);
+static void waveresampletile(void *arg, size_t i);
+static void wavereversetile(void *arg, size_t i);
+static void wavesilence(Wave *wave, char *l);
+static void wavesnap(Wave *wave);
+static void waveunpin(Pin *pin);
+static void wavestride(Wave *wave, size_t pos, size_t n, float *p,
+		char write);
+static void waveundo(Wave *wave);
+static void wavevolume(Wave *wave, char *l);
+static void wavevolumekern(void *arg, float *p, size_t n);
+static float wavelength(size_t wavesize, int sampleRate, int channels);
+static void wavereverse(Wave *wave);
+static void wavewrite(Wave *wave, size_t pos, size_t n, const float *src);
+static void writeall(int fd, const void *buf, size_t n, char *filename);
+static void writestats(char *filename);
+static void writewave(Wave wave, char *l);
+static void usage(void);
+#ifdef XVIEW
+static void viewapply(Wave *waves, size_t waven, Wave *wave);
+static void viewdraw(Wave *wave, int flags);
+static int viewevent(XEvent *ev, Wave *wave);
+static void viewfree(void);
+static void viewinit(void);
+static size_t viewloaded(Wave *wave);
+static void viewresize(int w, int h);
+static void viewwait(Wave *waves, size_t waven, int selwav);
+#endif
+
+#include "config.h"
+char *argv0;
+
+static struct {
+	Buf *b;
+	size_t ci;
+} *resident;                 /* chunks in memory, tracked under a budget */
+static size_t nresident, residentcap, residentbytes; /* against membudget */
+static unsigned long tick;   /* lru clock */
+static pthread_mutex_t storelock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t peaklock = PTHREAD_MUTEX_INITIALIZER; /* taken first */
+static pthread_cond_t loaded = PTHREAD_COND_INITIALIZER; /* a chunk came in */
+static Wave clip;            /* pieces cut or copied, shared by all waves */
+static const Codec *defcodec; /* -f, -s and -c, for waves without a header */
+static int defrate, defchannels;
+static char defplanar;       /* -P, waves are made planar as they are read */
+static char defprec;         /* -p, and kept in this precision */
+static struct {
+	float **t;
+	size_t n, size;
+} tiles;                     /* lent by wavepin() and given back */
+static struct {
+	unsigned char **s;
+	size_t n, size;
+} stages;                    /* of STAGE bytes, lent by bufload() */
+static const char *precnames[] = { [PrecF32] = "f32", [PrecF16] = "f16",
+	[PrecS16] = "s16" };
+static size_t cowbytes;      /* ever copied on write, charged to undo */
+static size_t touchbytes, readbytes, writebytes, nallocs; /* see Stat */
+static Stat *stats;          /* of each shell command, see :stats */
+static size_t nstats;
+static struct Slab {
+	void *free[SLABKEEP];
+	size_t nfree, reserved, used; /* slots */
+} slabs[2];                  /* of compact and of f32 chunks, see slabget() */
+static struct {
+	char *p, **old;      /* the block in use, those it outgrew */
+	size_t nold, used, size, reserved, peak;
+} arena;                     /* temporaries of a shell command */
+static size_t wavecap;       /* waves the table has room for */
+static size_t histbytes;     /* held by undo and redo entries */
+static unsigned long snapclock;
+
+#ifdef XVIEW
+static struct {
+	Display *dpy;
+	Window win;
+	Atom wmdelete;
+	Drw *drw;
+	Clr *scheme[SchemeLast];
+	int w, h, bh;      /* window and bar height */
+	double off, spp;   /* first frame shown, frames per column */
+	Peak *col;         /* what each column shows */
+	char *colsel;
+	int sel;           /* index of the wave shown */
+	int flags;         /* owed by lines read without a redraw */
+	char bar[256];
+} view = { .sel = -2 }; /* nothing shown yet */
+#endif
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t work, done;
+	void (*fn)(void *arg, size_t i);
+	void *arg;
+	size_t next, n, pending;
+	unsigned long gen;
+} pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+	PTHREAD_COND_INITIALIZER, NULL, NULL, 0, 0, 0, 0 };
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t done; /* a loader finished */
+	Loader **q;          /* waiting for a thread, in the order started */
+	size_t n, size;
+	int running;         /* loader threads, at most iodepth */
+} loads = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0, 0, 0 };
+
+typedef struct {
+	Wave *wave;
+	size_t l, r, ch; /* ch samples a frame */
+	void (*kern)(void *arg, float *p, size_t n);
+	void *arg;
+} MapJob;
+
+typedef struct {
+	Wave *wave;
+	size_t first;        /* block of task 0 */
+	Buf **src;           /* packed buffer holding each block, or NULL */
+	float **in;
+	unsigned char **out;
+	size_t *size;
+	Peak *pk;            /* level 0 peaks of the whole wave, or NULL */
+} PackJob;
+
+typedef struct {
+	Buf *b;
+	size_t *ci;
+} PeakJob;
+
+typedef struct {
+	Conv **cv;       /* a convolver per channel, carried across batches */
+	float **in;      /* each channel of the batch, convolved in place */
+	size_t n, ch;    /* frames of the batch, channels */
+	float *out;      /* interleaved */
+} ConvJob;
+
+typedef struct {
+	const Biquad *q;
+	size_t nq, n, ch; /* biquads, frames of the batch, channels */
+	float *p;         /* the batch, interleaved */
+	double *state;    /* of each EQLANES channels, carried across batches */
+} EqJob;
+
+typedef struct {
+	const Resampler *r;
+	float **in;      /* each channel of the batch's input */
+	int64_t a;       /* frame of in[c][0] */
+	uint64_t k;      /* first frame out */
+	size_t n, ch;    /* frames out, channels */
+	float *out;      /* interleaved */
+} ResampleJob;
+
+typedef struct {
+	uint32_t *buf[2];
+	size_t n[2];     /* samples waiting in each buffer, 0 once written */
+	int fd;
+	char done, fail;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} PlayJob;
+
+typedef struct {
+	float g, peak;
+	int limit;
+	size_t clipped;
+	pthread_mutex_t lock;
+} Gain;
+
+/* nmemb zeroed members on a cache line, lasting until the end of the
+ * shell command; a block outgrown is kept until then too */
+static void *
+arenaget(size_t nmemb, size_t size)
+{
+	size_t n = (nmemb * size + 63) / 64 * 64;
+	void *p;
+
+	if (arena.used + n > arena.size) {
+		if (arena.p != NULL) {
+			if ((arena.old = realloc(arena.old,
+							sizeof(*arena.old) * (arena.nold + 1))) == NULL)
+				die("realloc:");
+			arena.old[arena.nold++] = arena.p;
+		}
+		arena.size = MAX(2 * arena.size, n);
+		if (posix_memalign((void **)&arena.p, 64, arena.size))
+			die("posix_memalign:");
+		arena.reserved += arena.size;
+		arena.used = 0;
+		COUNT(nallocs, 1);
+	}
+	p = arena.p + arena.used;
+	arena.used += n;
+	arena.peak = MAX(arena.peak, arena.used);
+	memset(p, 0, n);
+	return p;
+}
+
+/* after a command that outgrew the block, one block holding as much as
+ * all of them takes their place */
+static void
+arenareset(void)
+{
+	size_t i;
+	if (arena.nold) {
+		for (i = 0; i < arena.nold; ++i)
+			free(arena.old[i]);
+		free(arena.p);
+		free(arena.old);
+		arena.old = NULL;
+		arena.nold = 0;
+		if (posix_memalign((void **)&arena.p, 64, arena.reserved))
+			die("posix_memalign:");
+		arena.size = arena.reserved;
+		COUNT(nallocs, 1);
+	}
+	arena.used = 0;
+}
+
+static void *
+bufchunk(Buf *b, size_t ci, char write, char pin)
+{
+	void *c;
+	pthread_mutex_lock(&storelock);
+	c = bufload(b, ci, write);
+	if (pin)
+		++b->pins[ci];
+	pthread_mutex_unlock(&storelock);
+	return c;
+}
+
+static void
+bufget(Buf *b, size_t pos, size_t n, void *dst)
+{
+	size_t got, size = PRECSIZE(b->prec);
+	for (; n; pos += got, dst = (char *)dst + size * got, n -= got) {
+		got = MIN(n, CHUNK - pos % CHUNK);
+		memcpy(dst, (char *)bufload(b, pos / CHUNK, 0) + size * (pos % CHUNK),
+				size * got);
+	}
+}
+
+/* storelock must be held; it is let go while a file is read, the chunk
+ * marked Loading so others wanting it wait instead of reading it too */
+static void *
+bufload(Buf *b, size_t ci, char write)
+{
+	size_t n = MIN(CHUNK, b->len - ci * CHUNK), size = PRECSIZE(b->prec);
+	size_t got, i;
+	unsigned char *stage;
+	char saved;
+	void *c;
+
+	while (b->chunk[ci] == NULL && (b->state[ci] & Loading))
+		pthread_cond_wait(&loaded, &storelock);
+	if ((c = b->chunk[ci]) == NULL) {
+		saved = b->state[ci] & Saved;
+		if (b->map && !saved) {
+			c = b->map + ci * CHUNK;
+		} else {
+			b->state[ci] |= Loading;
+			c = slabget(b->prec);
+			if (b->parent && !saved) { /* in the same precision */
+				bufget(b->parent, b->poff + CHUNK * ci, n, c);
+				/* once every chunk has been copied the parent is not
+				 * needed anymore, they come back from scratch from now */
+				b->state[ci] |= Dirty;
+				cowbytes += size * n;
+				if (!--b->unloaded) {
+					for (i = 0; i < b->nchunks; ++i)
+						if (b->pstate[i] == PeakParent)
+							b->pstate[i] = PeakStale;
+					bufput(b->parent);
+					b->parent = NULL;
+				}
+			} else if (saved || b->fd >= 0) {
+				stage = stages.n ? stages.s[--stages.n] : NULL;
+				pthread_mutex_unlock(&storelock);
+				if (stage == NULL && (stage = malloc(STAGE)) == NULL)
+					die("malloc:");
+				got = bufread(b, ci, c, n, saved, stage);
+				memset((char *)c + got, 0, size * n - got);
+				pthread_mutex_lock(&storelock);
+				if (stages.n == stages.size && (stages.s = realloc(stages.s,
+								sizeof(*stages.s) * (stages.size = 2 * stages.size + 4))) == NULL)
+					die("realloc:");
+				stages.s[stages.n++] = stage;
+			} else {
+				memset(c, 0, size * n);
+			}
+			b->state[ci] &= ~Loading;
+			pthread_cond_broadcast(&loaded);
+		}
+		b->chunk[ci] = c;
+		/* evict after loading, filling from a parent may have paged;
+		 * chunks pinned by workers may push us over for a while, a
+		 * chunk is charged whole whatever its length */
+		while (membudget && residentbytes + size * CHUNK > membudget) {
+			for (got = nresident, i = 0; i < nresident; ++i)
+				if (!resident[i].b->pins[resident[i].ci] && (got == nresident ||
+						resident[i].b->stamp[resident[i].ci] <
+						resident[got].b->stamp[resident[got].ci]))
+					got = i;
+			if (got == nresident)
+				break;
+			bufpageout(resident[got].b, resident[got].ci);
+		}
+		if (membudget) {
+			/* compact chunks take the least, 2 bytes a sample, and
+			 * workers and loaders may pin some more */
+			if (nresident == residentcap && (resident = realloc(resident,
+							sizeof(*resident) * (residentcap = MAX(2 * residentcap,
+									membudget / (2 * CHUNK) + nthreads + 1)))) == NULL)
+				die("realloc:");
+			resident[nresident].b = b;
+			resident[nresident++].ci = ci;
+			residentbytes += size * CHUNK;
+		}
+	}
+	b->stamp[ci] = ++tick;
+	if (write) {
+		b->state[ci] |= Dirty;
+		b->pstate[ci] = PeakStale;
+	}
+	return c;
+}
+
+static Buf *
+bufnew(size_t len, int fd, off_t offset, const Codec *codec)
+{
+	Buf *b = ecalloc(1, sizeof(Buf));
+	b->len = len;
+	b->nchunks = (len + CHUNK - 1) / CHUNK;
+	b->chunk = ecalloc(b->nchunks + 1, sizeof(*b->chunk));
+	b->stamp = ecalloc(b->nchunks + 1, sizeof(*b->stamp));
+	b->pins = ecalloc(b->nchunks + 1, sizeof(*b->pins));
+	b->pstate = ecalloc(b->nchunks + 1, sizeof(*b->pstate));
+	memset(b->pstate, PeakStale, b->nchunks);
+	b->plo = -1;
+	b->state = ecalloc(b->nchunks + 1, sizeof(*b->state));
+	b->fd = fd;
+	b->scratch = -1;
+	b->offset = offset;
+	b->codec = codec;
+	b->refs = 1;
+	return b;
+}
+
+static void
+bufpack(Buf *b, void *c, size_t off, size_t n, const float *t)
+{
+	if (b->prec == PrecF16)
+		ftof16((uint16_t *)c + off, t, n);
+	else if (b->prec == PrecS16)
+		ftos16((int16_t *)c + off, t, n);
+	else
+		memcpy((float *)c + off, t, sizeof(float) * n);
+}
+
+static void
+bufpageout(Buf *b, size_t ci)
+{
+	char path[] = "/tmp/med.XXXXXX";
+	size_t n = MIN(CHUNK, b->len - ci * CHUNK), size = PRECSIZE(b->prec), i;
+	void *c = b->chunk[ci];
+	off_t off = (off_t)size * CHUNK * ci;
+	uintptr_t pg, a, e;
+	ssize_t w;
+	char *p;
+
+	if (b->state[ci] & Dirty) {
+		if (b->scratch < 0) {
+			if ((b->scratch = mkstemp(path)) < 0)
+				die("unable to create scratch file %s:", path);
+			unlink(path);
+		}
+		for (p = c, i = size * n; i; i -= w, p += w, off += w)
+			if ((w = pwrite(b->scratch, p, i, off)) < 0 && errno != EINTR)
+				die("unable to write scratch file:");
+			else if (w < 0)
+				w = 0;
+		COUNT(writebytes, size * n);
+		b->state[ci] = Saved;
+	}
+	if (b->map && c == b->map + ci * CHUNK) {
+		/* only pages wholly in the chunk, a header before the samples
+		 * puts chunk edges inside pages */
+		pg = sysconf(_SC_PAGESIZE);
+		a = ((uintptr_t)c + pg - 1) / pg * pg;
+		e = (uintptr_t)((float *)c + n) / pg * pg;
+		if (a < e)
+			madvise((void *)a, e - a, MADV_DONTNEED);
+	} else {
+		slabput(b->prec, c);
+	}
+	b->chunk[ci] = NULL;
+	for (i = 0; i < nresident; ++i)
+		if (resident[i].b == b && resident[i].ci == ci) {
+			resident[i] = resident[--nresident];
+			residentbytes -= size * CHUNK;
+			break;
+		}
+}
+
+/* bytes of chunk ci read into c from scratch if saved, or from the
+ * source file, without storelock; compact chunks are decoded to the
+ * floats at the start of stage and packed from there */
+static size_t
+bufread(Buf *b, size_t ci, void *c, size_t n, char saved, unsigned char *stage)
+{
+	size_t size = PRECSIZE(b->prec), got;
+
+	if (saved)
+		return readall(b->scratch, c, size * n, (off_t)size * CHUNK * ci);
+	if (b->prec == PrecF32)
+		return bufsource(b, ci, c, n, stage);
+	got = bufsource(b, ci, (float *)stage, n,
+			stage + sizeof(float) * CHUNK) / sizeof(float);
+	bufpack(b, c, 0, got, (float *)stage);
+	return size * got;
+}
+
+/* stage holds the file's bytes of the chunk, 8 a sample at most */
+static size_t
+bufsource(Buf *b, size_t ci, float *c, size_t n, unsigned char *stage)
+{
+	const Codec *k = b->codec;
+	size_t got, i, m, blk, size;
+
+	/* packed blocks tile the chunk, each is read and decoded on its own */
+	if (b->seek != NULL) {
+		for (i = 0; i < n; i += m) {
+			blk = (CHUNK * ci + i) / b->blk;
+			m = MIN(b->blk, n - i);
+			size = b->seek[blk + 1] - b->seek[blk];
+			if (readall(b->fd, stage, size, b->seek[blk]) < size ||
+					packdecode(c + i, m, stage, size, b->channels) < 0)
+				die("broken block %lu in packed wave", (unsigned long)blk);
+		}
+		return sizeof(float) * n;
+	}
+	/* formats as wide as a float are decoded in place, others through
+	 * the stage; a short read leaves the rest to be zeroed */
+	if (k->size == sizeof(float)) {
+		got = readall(b->fd, c, sizeof(float) * n,
+				b->offset + (off_t)sizeof(float) * CHUNK * ci) / sizeof(float);
+		if (!codecnative(k))
+			k->decode(k, c, c, got);
+	} else {
+		got = readall(b->fd, stage, k->size * n,
+				b->offset + (off_t)k->size * CHUNK * ci) / k->size;
+		k->decode(k, c, stage, got);
+	}
+	return sizeof(float) * got;
+}
+
+static void
+bufpeakalloc(Buf *b)
+{
+	size_t k;
+	if (b->nlevels)
+		return;
+	b->npeak[0] = (b->len + PEAKBLK - 1) / PEAKBLK;
+	for (k = 0; k < PEAKLVLS && (k == 0 || b->npeak[k - 1] > 1); ++k) {
+		if (k)
+			b->npeak[k] = (b->npeak[k - 1] + PEAKBLK - 1) / PEAKBLK;
+		b->peak[k] = ecalloc(b->npeak[k], sizeof(Peak));
+	}
+	b->nlevels = k;
+}
+
+static void
+bufpeakchunk(void *arg, size_t i)
+{
+	PeakJob *j = arg;
+	Buf *b = j->b;
+	size_t ci = j->ci[i], pos = CHUNK * ci, n = MIN(CHUNK, b->len - pos);
+	size_t k, m, o;
+	float t[TILE];
+	const float *v;
+	void *c;
+
+	/* nothing to read back from a buffer without a source, it is silence */
+	if (!b->chunk[ci] && !b->map && b->fd < 0 && !b->parent &&
+			!(b->state[ci] & Saved)) {
+		memset(b->peak[0] + pos / PEAKBLK, 0,
+				sizeof(Peak) * ((n + PEAKBLK - 1) / PEAKBLK));
+		return;
+	}
+	c = bufchunk(b, ci, 0, 1);
+	for (k = 0; k < n; k += m) {
+		v = bufunpack(b, c, k, m = MIN(TILE, n - k), t);
+		for (o = 0; o < m; o += PEAKBLK)
+			peakscan(v + o, MIN(PEAKBLK, m - o),
+					b->peak[0] + (pos + k + o) / PEAKBLK);
+	}
+	bufunpin(b, ci);
+}
+
+static void
+bufpeakfresh(Buf *b, size_t a, size_t e)
+{
+	size_t ci, pc, k, lo, hi;
+	PeakJob j;
+
+	if (a >= e)
+		return;
+	bufpeakalloc(b);
+	for (ci = a / CHUNK; ci < (e + CHUNK - 1) / CHUNK &&
+			b->pstate[ci] == PeakFresh; ++ci)
+		;
+	if (ci == (e + CHUNK - 1) / CHUNK && b->plo >= b->phi)
+		return;
+
+	/* level 0 peaks of chunks still equal to the parent's are copied from
+	 * its pyramid, written ones are scanned again by the workers */
+	j.b = b;
+	j.ci = ecalloc(b->nchunks, sizeof(*j.ci));
+	for (k = 0, ci = a / CHUNK; ci < (e + CHUNK - 1) / CHUNK; ++ci) {
+		if (b->pstate[ci] == PeakFresh)
+			continue;
+		lo = CHUNK / PEAKBLK * ci;
+		hi = (MIN(b->len, CHUNK * (ci + 1)) + PEAKBLK - 1) / PEAKBLK;
+		if (b->pstate[ci] == PeakParent) {
+			pc = b->poff / CHUNK + ci;
+			bufpeakfresh(b->parent, CHUNK * pc, MIN(b->parent->len, CHUNK * (pc + 1)));
+			memcpy(b->peak[0] + lo, b->parent->peak[0] + CHUNK / PEAKBLK * pc,
+					sizeof(Peak) * (hi - lo));
+		} else {
+			j.ci[k++] = ci;
+		}
+		b->pstate[ci] = PeakFresh;
+		b->plo = MIN(b->plo, lo);
+		b->phi = MAX(b->phi, hi);
+	}
+	poolrun(bufpeakchunk, &j, k);
+	free(j.ci);
+	bufpeakup(b);
+}
+
+/* the levels above level 0, only over what changed */
+static void
+bufpeakup(Buf *b)
+{
+	size_t ci, k, lo, hi, i, end;
+	Peak *p;
+
+	for (lo = b->plo, hi = b->phi, k = 1; lo < hi && k < b->nlevels; ++k) {
+		lo /= PEAKBLK;
+		hi = (hi + PEAKBLK - 1) / PEAKBLK;
+		for (i = lo; i < hi; ++i) {
+			p = b->peak[k] + i;
+			p->min = p->max = p->sq = 0;
+			end = MIN(b->npeak[k - 1], PEAKBLK * (i + 1));
+			for (ci = PEAKBLK * i; ci < end; ++ci) {
+				p->min = ci == PEAKBLK * i || b->peak[k - 1][ci].min < p->min ?
+					b->peak[k - 1][ci].min : p->min;
+				p->max = ci == PEAKBLK * i || b->peak[k - 1][ci].max > p->max ?
+					b->peak[k - 1][ci].max : p->max;
+				p->sq += b->peak[k - 1][ci].sq;
+			}
+		}
+	}
+	b->plo = -1;
+	b->phi = 0;
+}
+
+static void
+bufpeaklevel(Buf *b, size_t k, size_t ba, size_t be, PeakSum *s)
+{
+	size_t ca, ce, i;
+	ca = (ba + PEAKBLK - 1) / PEAKBLK;
+	ce = k + 1 >= b->nlevels ? 0 :
+		be == b->npeak[k] ? b->npeak[k + 1] : be / PEAKBLK;
+	if (ca >= ce) {
+		for (i = ba; i < be; ++i)
+			peakadd(s, b->peak[k] + i);
+		return;
+	}
+	for (i = ba; i < PEAKBLK * ca; ++i)
+		peakadd(s, b->peak[k] + i);
+	for (i = PEAKBLK * ce; i < be; ++i)
+		peakadd(s, b->peak[k] + i);
+	bufpeaklevel(b, k + 1, ca, ce, s);
+}
+
+static void
+bufpeakraw(Buf *b, size_t a, size_t e, PeakSum *s)
+{
+	size_t ci, n;
+	float t[TILE];
+	void *c;
+	Peak p;
+	for (; a < e; a += n) {
+		ci = a / CHUNK;
+		n = MIN(e - a, CHUNK - a % CHUNK);
+		n = b->prec == PrecF32 ? n : MIN(n, TILE);
+		if (!b->chunk[ci] && b->pstate[ci] == PeakParent) {
+			bufpeakraw(b->parent, b->poff + a, b->poff + a + n, s);
+			continue;
+		}
+		c = bufchunk(b, ci, 0, 1);
+		peakscan(bufunpack(b, c, a % CHUNK, n, t), n, &p);
+		peakadd(s, &p);
+		bufunpin(b, ci);
+	}
+}
+
+static void
+bufpeaks(Buf *b, size_t a, size_t e, PeakSum *s)
+{
+	size_t ba, be;
+	if (a >= e)
+		return;
+	bufpeakfresh(b, a, e);
+	/* samples off the block grid at both ends, whole blocks in between */
+	ba = (a + PEAKBLK - 1) / PEAKBLK;
+	be = e == b->len ? b->npeak[0] : e / PEAKBLK;
+	if (ba >= be) {
+		bufpeakraw(b, a, e, s);
+		return;
+	}
+	bufpeakraw(b, a, PEAKBLK * ba, s);
+	bufpeakraw(b, MIN(e, PEAKBLK * be), e, s);
+	bufpeaklevel(b, 0, ba, be, s);
+}
+
+/* storelock must be held, a loader may be paging at the same time */
+static void
+bufput(Buf *b)
+{
+	size_t i;
+	if (--b->refs > 0)
+		return;
+	for (i = 0; i < nresident; ++i)
+		if (resident[i].b == b) {
+			resident[i--] = resident[--nresident];
+			residentbytes -= PRECSIZE(b->prec) * CHUNK;
+		}
+	for (i = 0; i < b->nchunks; ++i)
+		if (b->chunk[i] && !(b->map && b->chunk[i] == b->map + i * CHUNK))
+			slabput(b->prec, b->chunk[i]);
+	if (b->map)
+		munmap(b->mapbase, b->mapsize);
+	if (b->fd >= 0)
+		close(b->fd);
+	if (b->scratch >= 0)
+		close(b->scratch);
+	if (b->parent)
+		bufput(b->parent);
+	free(b->seek);
+	free(b->chunk);
+	free(b->stamp);
+	free(b->pins);
+	free(b->state);
+	free(b->pstate);
+	for (i = 0; i < b->nlevels; ++i)
+		free(b->peak[i]);
+	free(b);
+}
+
+static void
+bufrelease(Buf *b)
+{
+	pthread_mutex_lock(&storelock);
+	bufput(b);
+	pthread_mutex_unlock(&storelock);
+}
+
+/* n samples at off of chunk c as floats, unpacked into t if compact */
+static const float *
+bufunpack(Buf *b, const void *c, size_t off, size_t n, float *t)
+{
+	if (b->prec == PrecF16)
+		f16tof(t, (const uint16_t *)c + off, n);
+	else if (b->prec == PrecS16)
+		s16tof(t, (const int16_t *)c + off, n);
+	else
+		return (const float *)c + off;
+	return t;
+}
+
+static void
+bufunpin(Buf *b, size_t ci)
+{
+	pthread_mutex_lock(&storelock);
+	--b->pins[ci];
+	pthread_mutex_unlock(&storelock);
+}
+
+/* the pending edits of wave, charging what they copy to its history */
+static void
+applywave(Wave *waves, size_t waven, Wave *wave)
+{
+	size_t cow = cowbytes;
+	waveapply(wave);
+	histcharge(waves, waven, wave, cowbytes - cow);
+}
+
+static void
+changewavselection(Wave *wave, char isRight, char *l)
+{
+	size_t *val = isRight ? &(wave->rightSelection) : &(wave->leftSelection);
+	char secs = (l[strlen(l) - 1] == 's');
+	switch (*l) {
+	case '=': /* set to X number of samples/seconds */
+		*val = strtol(++l, NULL, 10) * wave->channels * (secs ? wave->sampleRate : 1);
+		break;
+	case '+': /* add X number of samples/seconds */
+		*val += strtol(++l, NULL, 10) * wave->channels * (secs ? wave->sampleRate : 1);
+		break;
+	case '-': /* remove X number of samples/seconds */
+		*val -= strtol(++l, NULL, 10) * wave->channels * (secs ? wave->sampleRate : 1);
+		break;
+	default:
+		printf("err: undefined char: %c\n", *l);
+		break;
+	}
+}
+
+static void
+docommand(Wave **waves, size_t *waven, int *selwav, char *l)
+{
+	size_t cow = cowbytes;
+	/* point-wise edits wait for whatever comes next to need the samples */
+	if (*selwav >= 0 && strcmpt("vol/", l, '/') && strncmp("stats", l, 5))
+		waveapply(&((*waves)[*selwav]));
+	if (!strcmp("stats", l))
+		printstats();
+	else if (!strcmpt("stats/", l, '/'))
+		writestats(l + 6);
+	else if (*selwav < 0)
+		puts("err: no selected wave");
+	else if(!strcmp("apply", l))
+		; /* done above */
+	else if(!strcmpt("conv/", l, '/'))
+		waveconvfile(&((*waves)[*selwav]), l + 5);
+	else if(!strcmp("copy", l))
+		wavecopy(&((*waves)[*selwav]));
+	else if(!strcmp("cut", l))
+		wavecut(&((*waves)[*selwav]));
+	else if(!strcmp("del", l))
+		wavedelete(&((*waves)[*selwav]));
+	else if(!strcmp("dump", l))
+		wavedump((*waves)[*selwav]);
+	else if(!strcmpt("eq/", l, '/'))
+		waveeq(&((*waves)[*selwav]), l + 3);
+	else if(!strcmpt("fir/", l, '/'))
+		wavefir(&((*waves)[*selwav]), l + 4);
+	else if(!strcmp("interleave", l))
+		waveplanar(&((*waves)[*selwav]), 0);
+	else if(!strcmp("paste", l))
+		wavepaste(&((*waves)[*selwav]));
+	else if(!strcmp("planar", l))
+		waveplanar(&((*waves)[*selwav]), 1);
+	else if(!strcmpt("prec/", l, '/'))
+		waveprecision(&((*waves)[*selwav]), l + 5);
+	else if(!strcmpt("resample/", l, '/'))
+		waveresample(&((*waves)[*selwav]), l + 9);
+	else if(!strcmp("rev", l))
+		wavereverse(&((*waves)[*selwav]));
+	else if(!strcmpt("silence/", l, '/'))
+		wavesilence(&((*waves)[*selwav]), l + 8);
+	else if(!strcmpt("vol/", l, '/'))
+		wavevolume(&((*waves)[*selwav]), l + 4);
+	else
+		puts("?");
+	if (*selwav >= 0)
+		histcharge(*waves, *waven, &((*waves)[*selwav]), cowbytes - cow);
+}
+
+static void
+editwave(Wave **waves, size_t *waven, char *wname)
+{
+	size_t ls = 0;
+	ssize_t lr;
+	char *line = NULL;
+
+	waveslot(waves, waven);
+	if (*wname == '\0') {
+		printf("filename: ");
+		if ((lr = getline(&line, &ls, stdin)) > 0 && line[lr - 1] == '\n')
+			line[lr - 1] = '\0';
+		wname = lr > 0 ? line : "";
+	}
+	if (readwave(&(*waves)[(*waven) - 1], wname, defcodec, defrate,
+				defchannels, defprec, 1) < 0) {
+		free(line);
+		--*waven;
+		return;
+	}
+	free(line);
+	if (defplanar)
+		wavelayout(&(*waves)[(*waven) - 1], 1, defprec);
+	(*waves)[(*waven) - 1].leftSelection =
+		(*waves)[(*waven) - 1].rightSelection = -1;
+	(*waves)[(*waven) - 1].modificated = 0;
+	(*waves)[(*waven) - 1].undo = (*waves)[(*waven) - 1].redo = NULL;
+	(*waves)[(*waven) - 1].nundo = (*waves)[(*waven) - 1].nredo = 0;
+}
+
+static void
+freewave(Wave *wave)
+{
+	loadfree(wave, LoadStop);
+	free(wave->name);
+	wave->name = NULL;
+	pieceremove(wave, 0, wave->npieces);
+	free(wave->piece);
+	wave->piece = NULL;
+	wave->wsize = 0;
+	free(wave->ops);
+	wave->ops = NULL;
+	wave->nops = 0;
+	histfree(wave->undo, wave->nundo);
+	histfree(wave->redo, wave->nredo);
+	free(wave->undo);
+	free(wave->redo);
+	wave->undo = wave->redo = NULL;
+	wave->nundo = wave->nredo = 0;
+}
+
+static void
+histcharge(Wave *waves, size_t waven, Wave *wave, size_t bytes)
+{
+	Wave *old;
+	size_t i;
+
+	if (wave->nundo) {
+		wave->undo[wave->nundo - 1].cost += bytes;
+		histbytes += bytes;
+	}
+	/* drop the oldest undo entries of any wave until under the limit */
+	while (histbytes > undolimit) {
+		for (old = NULL, i = 0; i < waven; ++i)
+			if (waves[i].nundo && (old == NULL ||
+						waves[i].undo[0].stamp < old->undo[0].stamp))
+				old = &waves[i];
+		if (old == NULL)
+			break;
+		histfree(old->undo, 1);
+		memmove(old->undo, old->undo + 1, sizeof(Snap) * --old->nundo);
+	}
+}
+
+static void
+histfree(Snap *s, size_t n)
+{
+	size_t i;
+	for (; n--; ++s) {
+		for (i = 0; i < s->npieces; ++i)
+			bufrelease(s->piece[i].buf);
+		free(s->piece);
+		free(s->ops);
+		histbytes -= s->cost;
+	}
+}
+
+static uint64_t
+getle(const unsigned char *p, int n)
+{
+	uint64_t v = 0;
+	while (n--)
+		v = v << 8 | p[n];
+	return v;
+}
+
+static char
+hostendianness(void)
+{
+	union {
+		uint32_t u;
+		char c[4];
+	} e = { 1 };
+	return e.c[0] == 0;
+}
+
+/* lets go of the loader of wave once it is done; LoadPoll leaves it
+ * running, LoadWait waits for it and LoadStop stops it first */
+static void
+loadfree(Wave *wave, int how)
+{
+	Loader *l = wave->load;
+	size_t i;
+
+	if (l == NULL)
+		return;
+	pthread_mutex_lock(&loads.lock);
+	if (how == LoadPoll && !l->finished) {
+		pthread_mutex_unlock(&loads.lock);
+		return;
+	}
+	if (how == LoadStop) {
+		__atomic_store_n(&l->stop, 1, __ATOMIC_RELAXED);
+		for (i = 0; i < loads.n && loads.q[i] != l; ++i)
+			;
+		if (i < loads.n) {
+			memmove(loads.q + i, loads.q + i + 1,
+					sizeof(*loads.q) * (--loads.n - i));
+			l->finished = 1;
+		}
+	}
+	while (!l->finished)
+		pthread_cond_wait(&loads.done, &loads.lock);
+	pthread_mutex_unlock(&loads.lock);
+	bufrelease(l->b);
+	free(l->filename);
+	free(l);
+	wave->load = NULL;
+}
+
+static int
+loadprogress(Loader *l)
+{
+	return 100 * __atomic_load_n(&l->done, __ATOMIC_RELAXED) / l->b->nchunks;
+}
+
+/* the peaks of the wave from its sidecar, or chunk by chunk in file
+ * order; a command wanting peaks further on scans what it needs itself
+ * under peaklock, and samples need no waiting, any chunk is read in
+ * when first touched */
+static void
+loadrun(Loader *l)
+{
+	Buf *b = l->b;
+	struct stat st;
+	size_t ci;
+	PeakJob j;
+	int ok, fresh;
+
+	pthread_mutex_lock(&peaklock);
+	ok = peakload(b, l->filename, &l->st);
+	pthread_mutex_unlock(&peaklock);
+	if (ok) {
+		__atomic_store_n(&l->done, b->nchunks, __ATOMIC_RELAXED);
+		return;
+	}
+	j.b = b;
+	j.ci = &ci;
+	for (ci = 0; ci < b->nchunks &&
+			!__atomic_load_n(&l->stop, __ATOMIC_RELAXED); ++ci) {
+		/* the chunk is read in before peaklock is taken, so loaders
+		 * only take turns for the scan */
+		pthread_mutex_lock(&peaklock);
+		fresh = b->pstate[ci] == PeakFresh;
+		pthread_mutex_unlock(&peaklock);
+		if (!fresh)
+			bufchunk(b, ci, 0, 1);
+		pthread_mutex_lock(&peaklock);
+		if (b->pstate[ci] != PeakFresh) {
+			bufpeakchunk(&j, 0);
+			b->pstate[ci] = PeakFresh;
+			b->plo = MIN(b->plo, CHUNK / PEAKBLK * ci);
+			b->phi = MAX(b->phi,
+					(MIN(b->len, CHUNK * (ci + 1)) + PEAKBLK - 1) / PEAKBLK);
+		}
+		pthread_mutex_unlock(&peaklock);
+		if (!fresh)
+			bufunpin(b, ci);
+		__atomic_store_n(&l->done, ci + 1, __ATOMIC_RELAXED);
+	}
+	if (ci < b->nchunks)
+		return;
+	pthread_mutex_lock(&peaklock);
+	bufpeakup(b);
+	/* not over a file replaced while it was read */
+	if (l->store && stat(l->filename, &st) == 0 &&
+			st.st_ino == l->st.st_ino && st.st_size == l->st.st_size &&
+			st.st_mtim.tv_sec == l->st.st_mtim.tv_sec &&
+			st.st_mtim.tv_nsec == l->st.st_mtim.tv_nsec)
+		peakstore(b->peak[0], b->npeak[0], l->filename, l->codec);
+	pthread_mutex_unlock(&peaklock);
+}
+
+/* queues the loading of b read from filename, taken up by one of at most
+ * iodepth loader threads so a disk is not read in too many places */
+static Loader *
+loadstart(Buf *b, char *filename, const Codec *codec, struct stat *st,
+		char store)
+{
+	Loader *l = ecalloc(1, sizeof(Loader));
+	pthread_t t;
+
+	if ((l->filename = strdup(filename)) == NULL)
+		die("strdup:");
+	l->b = b;
+	l->codec = codec;
+	l->st = *st;
+	l->store = store;
+	++b->refs;
+	bufpeakalloc(b);
+	pthread_mutex_lock(&loads.lock);
+	if (loads.n == loads.size && (loads.q = realloc(loads.q,
+					sizeof(*loads.q) * (loads.size = 2 * loads.size + 4))) == NULL)
+		die("realloc:");
+	loads.q[loads.n++] = l;
+	if (loads.running < MAX(iodepth, 1)) {
+		if (pthread_create(&t, NULL, loadthread, NULL))
+			die("pthread_create:");
+		pthread_detach(t);
+		++loads.running;
+	}
+	pthread_mutex_unlock(&loads.lock);
+	return l;
+}
+
+static void *
+loadthread(void *unused)
+{
+	Loader *l;
+
+	(void)unused;
+	pthread_mutex_lock(&loads.lock);
+	while (loads.n) {
+		l = loads.q[0];
+		memmove(loads.q, loads.q + 1, sizeof(*loads.q) * --loads.n);
+		pthread_mutex_unlock(&loads.lock);
+		loadrun(l);
+		pthread_mutex_lock(&loads.lock);
+		l->finished = 1;
+		pthread_cond_broadcast(&loads.done);
+	}
+	--loads.running;
+	pthread_mutex_unlock(&loads.lock);
+	return NULL;
+}
+
+static void
+newwave(Wave **waves, size_t *waven, char *wname)
+{
+	size_t ls = 0;
+	ssize_t lr = 0;
+	char *line = NULL;
+
+	waveslot(waves, waven);
+	if (*wname == '\0') {
+		printf("name [blank for default]: ");
+		if ((lr = getline(&line, &ls, stdin)) > 0 && line[lr - 1] == '\n')
+			line[--lr] = '\0';
+		wname = lr > 0 ? line : "[no name]";
+	}
+	if (((*waves)[(*waven) - 1].name = strdup(wname)) == NULL)
+		die("strdup:");
+	free(line);
+	(*waves)[(*waven) - 1].piece = NULL;
+	(*waves)[(*waven) - 1].npieces = (*waves)[(*waven) - 1].wsize = 0;
+	(*waves)[(*waven) - 1].leftSelection =
+		(*waves)[(*waven) - 1].rightSelection = -1;
+	(*waves)[(*waven) - 1].modificated = 0;
+	(*waves)[(*waven) - 1].ops = NULL;
+	(*waves)[(*waven) - 1].nops = 0;
+	(*waves)[(*waven) - 1].undo = (*waves)[(*waven) - 1].redo = NULL;
+	(*waves)[(*waven) - 1].nundo = (*waves)[(*waven) - 1].nredo = 0;
+	(*waves)[(*waven) - 1].load = NULL;
+	(*waves)[(*waven) - 1].sampleRate = defrate;
+	(*waves)[(*waven) - 1].channels = defchannels;
+	(*waves)[(*waven) - 1].codec = defcodec;
+	(*waves)[(*waven) - 1].head = Raw;
+	(*waves)[(*waven) - 1].planar = defplanar;
+	(*waves)[(*waven) - 1].prec = defprec;
+}
+
+static void
+packblock(void *arg, size_t i)
+{
+	PackJob *j = arg;
+	size_t blk = j->first + i, pos = PACKBLK * blk, k;
+	size_t n = MIN(PACKBLK, j->wave->wsize - pos);
+	Buf *b = j->src[i];
+
+	if (b != NULL) {
+		j->size[i] = b->seek[blk + 1] - b->seek[blk];
+		if (readall(b->fd, j->out[i], j->size[i], b->seek[blk]) < j->size[i])
+			die("broken block %lu in packed wave", (unsigned long)blk);
+		if (j->pk != NULL)
+			memcpy(j->pk + pos / PEAKBLK, b->peak[0] + pos / PEAKBLK,
+					sizeof(Peak) * ((n + PEAKBLK - 1) / PEAKBLK));
+		return;
+	}
+	waveread(j->wave, pos, n, j->in[i]);
+	for (k = 0; j->pk != NULL && k < n; k += PEAKBLK)
+		peakscan(j->in[i] + k, MIN(PEAKBLK, n - k), j->pk + (pos + k) / PEAKBLK);
+	j->size[i] = packencode(j->out[i], j->in[i], n, j->wave->channels);
+}
+
+/* the packed buffer still holding the n samples at pos of the wave as
+ * its block at pos, with their peaks; NULL once they were edited or
+ * moved */
+static Buf *
+packsame(Wave *wave, size_t pos, size_t n)
+{
+	Piece *p = wave->piece + piecefind(wave, pos);
+	Buf *b = p->buf;
+	size_t bpos = p->off + (pos - p->pos), ci;
+
+	/* nor are rounded samples */
+	if (p->pos + p->len < pos + n || b->prec != PrecF32)
+		return NULL;
+	/* a child's chunks that were never loaded are still its parent's */
+	for (; b != NULL; bpos += b->poff, b = b->parent) {
+		for (ci = bpos / CHUNK; ci <= (bpos + n - 1) / CHUNK; ++ci)
+			if (b->state[ci])
+				return NULL;
+		if (b->seek != NULL)
+			return bpos == pos && b->blk == PACKBLK &&
+				b->channels == wave->channels &&
+				MIN(PACKBLK, b->len - pos) == n && b->peak[0] != NULL &&
+				b->pstate[pos / CHUNK] == PeakFresh ? b : NULL;
+	}
+	return NULL;
+}
+
+/* blocks are coded by the workers a batch at a time and written in
+ * order, the seek table after them and the header last */
+static void
+packsave(int fd, Wave *wave, char *filename, Peak *pk)
+{
+	unsigned char h[PACKHDR] = { 0 };
+	size_t nb = (wave->wsize + PACKBLK - 1) / PACKBLK, nj = 2 * nthreads;
+	size_t i, n;
+	uint64_t *seek = arenaget(nb + 1, sizeof(*seek)), off = PACKHDR;
+	PackJob j;
+
+	j.wave = wave;
+	j.pk = pk;
+	j.src = arenaget(nj, sizeof(*j.src));
+	j.in = arenaget(nj, sizeof(*j.in));
+	j.out = arenaget(nj, sizeof(*j.out));
+	j.size = arenaget(nj, sizeof(*j.size));
+	for (i = 0; i < nj; ++i) {
+		j.in[i] = arenaget(PACKBLK, sizeof(float));
+		j.out[i] = arenaget(PACKMAX(PACKBLK), 1);
+	}
+	writeall(fd, h, PACKHDR, filename);
+	pthread_mutex_lock(&peaklock);
+	for (j.first = 0; j.first < nb; j.first += n) {
+		n = MIN(nj, nb - j.first);
+		for (i = 0; i < n; ++i)
+			/* a planar wave has its blocks coded again */
+			j.src[i] = wave->planar ? NULL :
+				packsame(wave, PACKBLK * (j.first + i),
+					MIN(PACKBLK, wave->wsize - PACKBLK * (j.first + i)));
+		poolrun(packblock, &j, n);
+		for (i = 0; i < n; off += j.size[i++]) {
+			seek[j.first + i] = off;
+			writeall(fd, j.out[i], j.size[i], filename);
+		}
+	}
+	pthread_mutex_unlock(&peaklock);
+	seek[nb] = off;
+	for (i = 0; i <= nb; ++i)
+		putle((unsigned char *)(seek + i), seek[i], 8);
+	writeall(fd, seek, sizeof(*seek) * (nb + 1), filename);
+
+	memcpy(h, PACKMAGIC, 8);
+	putle(h + 8, wave->sampleRate, 4);
+	putle(h + 12, wave->channels, 4);
+	putle(h + 16, wave->wsize, 8);
+	putle(h + 24, PACKBLK, 4);
+	putle(h + 32, off, 8);
+	if (pwrite(fd, h, PACKHDR, 0) != PACKHDR)
+		die("unable to write %s:", filename);
+}
+
+static void
+playwave(Wave wave)
+{
+	static uint32_t blocks[2][PLAYBUF];
+	PlayJob j = { { blocks[0], blocks[1] }, { 0, 0 }, -1, 0, 0,
+		PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+	void (*oldint)(int), (*oldpipe)(int);
+	char cmd[BUFSIZ];
+	int pfd[2], i, fail = 0;
+	size_t l, r, n;
+	pid_t pid;
+	pthread_t writer;
+
+	/* the selection, or everything after the cursor when it is empty */
+	waverange(&wave, &l, &r);
+	if (l == r)
+		r = wave.wsize;
+	snprintf(cmd, sizeof(cmd), player, wave.sampleRate, wave.channels);
+	if (pipe(pfd) < 0 || (pid = fork()) < 0) {
+		printf("err: unable to start player: %s\n", strerror(errno));
+		return;
+	}
+	if (pid == 0) {
+		dup2(pfd[0], STDIN_FILENO);
+		close(pfd[0]);
+		close(pfd[1]);
+		execl("/bin/sh", "sh", "-c", cmd, (char *)NULL);
+		_exit(127);
+	}
+	close(pfd[0]);
+	/* ^C stops the player, and the writes failing stop the stream */
+	oldint = signal(SIGINT, SIG_IGN);
+	oldpipe = signal(SIGPIPE, SIG_IGN);
+	printf("playing: wave \"%s\" @ %dHz with %d channels\n",
+			wave.name, wave.sampleRate, wave.channels);
+	fflush(stdout);
+
+	/* blocks are filled here while the writer thread hands the other one
+	 * to the player, so it starts as soon as the first block is out */
+	j.fd = pfd[1];
+	if (pthread_create(&writer, NULL, playwriter, &j))
+		die("pthread_create:");
+	for (i = 0; l < r; l += n, i ^= 1) {
+		pthread_mutex_lock(&j.lock);
+		while (j.n[i] && !j.fail)
+			pthread_cond_wait(&j.cond, &j.lock);
+		fail = j.fail;
+		pthread_mutex_unlock(&j.lock);
+		if (fail)
+			break;
+		n = MIN(r - l, PLAYBUF);
+		waveread(&wave, l, n, (float *)j.buf[i]);
+		if (hostendianness()) /* the player reads f32le */
+			swab32(j.buf[i], j.buf[i], n);
+		pthread_mutex_lock(&j.lock);
+		j.n[i] = n;
+		pthread_cond_broadcast(&j.cond);
+		pthread_mutex_unlock(&j.lock);
+	}
+	pthread_mutex_lock(&j.lock);
+	j.done = 1;
+	pthread_cond_broadcast(&j.cond);
+	pthread_mutex_unlock(&j.lock);
+	pthread_join(writer, NULL);
+	close(pfd[1]);
+	while (waitpid(pid, NULL, 0) < 0 && errno == EINTR)
+		;
+	signal(SIGINT, oldint);
+	signal(SIGPIPE, oldpipe);
+}
+
+static void *
+playwriter(void *arg)
+{
+	PlayJob *j = arg;
+	ssize_t w;
+	size_t off, len;
+	int i;
+
+	for (i = 0;; i ^= 1) {
+		pthread_mutex_lock(&j->lock);
+		while (!j->n[i] && !j->done)
+			pthread_cond_wait(&j->cond, &j->lock);
+		len = sizeof(*j->buf[i]) * j->n[i];
+		pthread_mutex_unlock(&j->lock);
+		if (!len)
+			break;
+		for (off = 0; off < len; off += w) {
+			if ((w = write(j->fd, (char *)j->buf[i] + off, len - off)) < 0) {
+				if (errno == EINTR) {
+					w = 0;
+					continue;
+				}
+				break;
+			}
+		}
+		COUNT(writebytes, off);
+		pthread_mutex_lock(&j->lock);
+		j->fail = off < len;
+		j->n[i] = 0;
+		pthread_cond_broadcast(&j->cond);
+		pthread_mutex_unlock(&j->lock);
+		if (j->fail)
+			break;
+	}
+	return NULL;
+}
+
+static void
+piececow(Piece *p)
+{
+	/* the copy keeps the parent's chunk grid, so its chunks are copied
+	 * whole and their peaks can be taken over as they are */
+	size_t base = p->off / CHUNK * CHUNK;
+	Buf *b = bufnew(MIN(p->buf->len, (p->off + p->len + CHUNK - 1) /
+				CHUNK * CHUNK) - base, -1, 0, 0);
+	b->parent = p->buf;
+	b->prec = p->buf->prec;
+	b->poff = base;
+	b->unloaded = b->nchunks;
+	memset(b->pstate, PeakParent, b->nchunks);
+	p->buf = b;
+	p->off -= base;
+}
+
+static void
+peakadd(PeakSum *s, const Peak *p)
+{
+	s->min = MIN(s->min, p->min);
+	s->max = MAX(s->max, p->max);
+	s->sq += p->sq;
+}
+
+static int
+peakload(Buf *b, char *filename, struct stat *st)
+{
+	char *path;
+	FILE *fp;
+	PeakHeader h;
+	int ok = 0;
+
+	if ((path = malloc(strlen(filename) + 4)) == NULL)
+		die("malloc:");
+	sprintf(path, "%s.pk", filename);
+	if ((fp = fopen(path, "r")) != NULL) {
+		if (fread(&h, sizeof(h), 1, fp) == 1 &&
+				!memcmp(h.magic, PEAKMAGIC, sizeof(h.magic)) &&
+				b->codec != NULL && !strncmp(h.codec, b->codec->name, sizeof(h.codec)) &&
+				h.size == (uint64_t)st->st_size &&
+				h.mtime == (int64_t)st->st_mtim.tv_sec &&
+				h.mtimensec == (int64_t)st->st_mtim.tv_nsec &&
+				h.n == (b->len + PEAKBLK - 1) / PEAKBLK) {
+			bufpeakalloc(b);
+			if ((ok = fread(b->peak[0], sizeof(Peak), h.n, fp) == h.n)) {
+				memset(b->pstate, PeakFresh, b->nchunks);
+				b->plo = 0;
+				b->phi = h.n;
+				bufpeakfresh(b, 0, b->len);
+			}
+		}
+		fclose(fp);
+	}
+	free(path);
+	return ok;
+}
+
+static void
+peakscan(const float *p, size_t n, Peak *pk)
+{
+	float min = n ? p[0] : 0, max = min, sq = 0;
+	size_t i;
+	for (i = 0; i < n; ++i) {
+		min = p[i] < min ? p[i] : min;
+		max = p[i] > max ? p[i] : max;
+		sq += p[i] * p[i];
+	}
+	pk->min = min;
+	pk->max = max;
+	pk->sq = sq;
+}
+
+static void
+peakstore(const Peak *p, size_t n, char *filename, const Codec *codec)
+{
+	char *path;
+	FILE *fp;
+	struct stat st;
+	PeakHeader h;
+
+	/* the sidecar is only a cache, failing to write it is not an error */
+	if (stat(filename, &st) < 0 ||
+			(path = malloc(strlen(filename) + 4)) == NULL)
+		return;
+	sprintf(path, "%s.pk", filename);
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, PEAKMAGIC, sizeof(h.magic));
+	snprintf(h.codec, sizeof(h.codec), "%s", codec->name);
+	h.size = st.st_size;
+	h.mtime = st.st_mtim.tv_sec;
+	h.mtimensec = st.st_mtim.tv_nsec;
+	h.n = n;
+	if ((fp = fopen(path, "w")) != NULL) {
+		if (fwrite(&h, sizeof(h), 1, fp) != 1 ||
+				fwrite(p, sizeof(Peak), n, fp) != n)
+			unlink(path);
+		fclose(fp);
+	}
+	free(path);
+}
+
+static size_t
+piecefind(Wave *wave, size_t pos)
+{
+	size_t lo = 0, hi = wave->npieces, mid;
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if (wave->piece[mid].pos <= pos)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static void
+pieceinsert(Wave *wave, size_t i, const Piece *p, size_t n)
+{
+	size_t j;
+	if (!n)
+		return;
+	if ((wave->piece = realloc(wave->piece,
+					sizeof(Piece) * (wave->npieces + n))) == NULL)
+		die("realloc:");
+	memmove(wave->piece + i + n, wave->piece + i,
+			sizeof(Piece) * (wave->npieces - i));
+	memcpy(wave->piece + i, p, sizeof(Piece) * n);
+	wave->npieces += n;
+	for (j = i; j < wave->npieces; ++j)
+		wave->piece[j].pos = j ? wave->piece[j - 1].pos + wave->piece[j - 1].len : 0;
+}
+
+static void
+pieceremove(Wave *wave, size_t i, size_t n)
+{
+	size_t j;
+	if (!n)
+		return;
+	for (j = i; j < i + n; ++j)
+		bufrelease(wave->piece[j].buf);
+	memmove(wave->piece + i, wave->piece + i + n,
+			sizeof(Piece) * (wave->npieces - i - n));
+	wave->npieces -= n;
+	for (j = i; j < wave->npieces; ++j)
+		wave->piece[j].pos = j ? wave->piece[j - 1].pos + wave->piece[j - 1].len : 0;
+}
+
+static size_t
+piecesplit(Wave *wave, size_t pos)
+{
+	size_t i, d;
+	Piece p;
+	if (pos >= wave->wsize)
+		return wave->npieces;
+	i = piecefind(wave, pos);
+	if ((d = pos - wave->piece[i].pos) == 0)
+		return i;
+	p = wave->piece[i];
+	p.off += d;
+	p.len -= d;
+	wave->piece[i].len = d;
+	++p.buf->refs;
+	pieceinsert(wave, i + 1, &p, 1);
+	return i + 1;
+}
+
+static void
+poolinit(int n)
+{
+	pthread_t t;
+	while (--n > 0)
+		if (pthread_create(&t, NULL, poolworker, NULL))
+			die("pthread_create:");
+}
+
+static void
+poolrun(void (*fn)(void *arg, size_t i), void *arg, size_t n)
+{
+	size_t i;
+	if (nthreads < 2 || n < 2) {
+		for (i = 0; i < n; ++i)
+			fn(arg, i);
+		return;
+	}
+	pthread_mutex_lock(&pool.lock);
+	pool.fn = fn;
+	pool.arg = arg;
+	pool.next = 0;
+	pool.n = pool.pending = n;
+	++pool.gen;
+	pthread_cond_broadcast(&pool.work);
+	/* the caller works along and returns once every task is finished */
+	while ((i = pool.next) < pool.n) {
+		++pool.next;
+		pthread_mutex_unlock(&pool.lock);
+		fn(arg, i);
+		pthread_mutex_lock(&pool.lock);
+		--pool.pending;
+	}
+	while (pool.pending)
+		pthread_cond_wait(&pool.done, &pool.lock);
+	pthread_mutex_unlock(&pool.lock);
+}
+
+static void *
+poolworker(void *unused)
+{
+	unsigned long gen = 0;
+	void (*fn)(void *arg, size_t i);
+	void *arg;
+	size_t i;
+
+	(void)unused;
+	pthread_mutex_lock(&pool.lock);
+	for (;;) {
+		while (pool.gen == gen)
+			pthread_cond_wait(&pool.work, &pool.lock);
+		gen = pool.gen;
+		while ((i = pool.next) < pool.n) {
+			++pool.next;
+			fn = pool.fn;
+			arg = pool.arg;
+			pthread_mutex_unlock(&pool.lock);
+			fn(arg, i);
+			pthread_mutex_lock(&pool.lock);
+			if (!--pool.pending)
+				pthread_cond_signal(&pool.done);
+		}
+	}
+	return NULL;
+}
+
+static int
+precfind(const char *name)
+{
+	int p;
+	for (p = 0; p < (int)LENGTH(precnames); ++p)
+		if (!strcmp(name, precnames[p]))
+			return p;
+	return -1;
+}
+
+static void
+printstats(void)
+{
+	Stat *s;
+	printf("%-20s %8s %8s %9s %9s %9s %9s %7s %7s %8s\n", "command",
+			"wall s", "cpu s", "touch MB", "MB/s", "read MB", "write MB",
+			"faults", "allocs", "rss+ kB");
+	for (s = stats; s < stats + nstats; ++s)
+		printf("%-20s %8.3f %8.3f %9.1f %9.1f %9.1f %9.1f %7ld %7lu %8ld\n",
+				s->cmd, s->wall, s->cpu, s->touched / 1e6,
+				s->wall > 0 ? s->touched / s->wall / 1e6 : 0,
+				s->read / 1e6, s->written / 1e6, s->faults,
+				(unsigned long)s->allocs, s->rss);
+	printf("slabs: %.1fMB reserved, %.1fMB used; scratch: %.1fMB reserved, "
+			"%.1fMB used at most\n",
+			(slabs[0].reserved * 2 + slabs[1].reserved * 4) * CHUNK / 1e6,
+			(slabs[0].used * 2 + slabs[1].used * 4) * CHUNK / 1e6,
+			arena.size / 1e6, arena.peak / 1e6);
+}
+
+static void
+printwaveinfo(Wave wave)
+{
+	PeakSum ps;
+	char lvl[96];
+
+	if (wave.name == NULL) {
+		puts("wave is null");
+		return;
+	}
+	/* the peak pyramid answers for the whole wave without a scan, but
+	 * is not waited for while the wave is still loading */
+	if (wave.load != NULL) {
+		snprintf(lvl, sizeof(lvl), "\tloading:          %d%%,\n",
+				loadprogress(wave.load));
+	} else {
+		wavepeaks(&wave, 0, wave.wsize, &ps, 0);
+		snprintf(lvl, sizeof(lvl), "\tpeak:             %.2fdBFS,\n"
+				"\trms:              %.2fdBFS,\n",
+				20 * log10(MAX(-ps.min, ps.max)),
+				10 * log10(wave.wsize ? ps.sq / wave.wsize : 0));
+	}
+	printf("\"%s\":\n\
+\tformat:           %s%s,\n\
+\tsample rate:      %d,\n\
+\tchannels:         %d,\n\
+\tlayout:           %s,\n\
+\tprecision:        %s,\n\
+\twave length:      %fs,\n\
+\tleft selection:  +%fs,\n\
+\tright selection: +%fs,\n\
+\tselection size:   %fs,\n\
+%s\
+\tresident:         %lu bytes,\n\
+\tmodificated:      %s;\n",
+			wave.name, wave.codec->name, wave.head == Riff ? " wav" :
+			wave.head == Pack ? " packed" : "", wave.sampleRate, wave.channels,
+			wave.planar ? "planar" : "interleaved", precnames[(int)wave.prec],
+			wavelength(wave.wsize, wave.sampleRate, wave.channels),
+			wave.leftSelection == -1 ? 0 :
+				wavelength(wave.leftSelection, wave.sampleRate, wave.channels),
+			wave.rightSelection == -1 ?
+				wavelength(wave.wsize, wave.sampleRate, wave.channels) :
+				wavelength(wave.rightSelection, wave.sampleRate, wave.channels),
+			wavelength(
+				(wave.rightSelection == -1 ? wave.wsize :
+					wave.rightSelection) -
+				(wave.leftSelection == -1 ? 0 :
+					wave.leftSelection),
+				wave.sampleRate, wave.channels),
+			lvl, (unsigned long)waveresident(&wave),
+			wave.modificated ? "yes" : "no");
+}
+
+static void
+printwavelist(Wave *waves, size_t waven)
+{
+	Wave *ws = waves--;
+	while ((++waves - ws) < waven)
+		if ((*waves).load != NULL)
+			printf("[%ld]: \"%s\" (loading %d%%)\n",
+				waves - ws, (*waves).name, loadprogress((*waves).load));
+		else
+			printf("[%ld]: \"%s\"\n",
+				waves - ws, (*waves).name);
+}
+
+static void
+putle(unsigned char *p, uint64_t v, int n)
+{
+	for (; n--; v >>= 8)
+		*p++ = v;
+}
+
+static size_t
+readall(int fd, void *buf, size_t n, off_t off)
+{
+	ssize_t r;
+	size_t got = 0;
+	while (got < n) {
+		if ((r = pread(fd, (char *)buf + got, n - got, off + got)) < 0) {
+			if (errno == EINTR)
+				continue;
+			die("unable to read wave:");
+		}
+		if (r == 0)
+			break;
+		got += r;
+	}
+	COUNT(readbytes, got);
+	return got;
+}
+
+/* the container of a wave, Riff or Pack with its format, rate, channels
+ * and samples in h, Raw for a file without a header and -1 for a broken
+ * one */
+static int
+readheader(int fd, off_t fsize, Header *h)
+{
+	unsigned char b[PACKHDR];
+	uint64_t pos, len, ds64 = 0;
+	int rf64, tag = -1, bits = 0;
+	char name[16];
+
+	if (readall(fd, b, PACKHDR, 0) == PACKHDR &&
+			!memcmp(b, PACKMAGIC, 8)) {
+		h->codec = codecfind("f32le");
+		h->rate = getle(b + 8, 4);
+		h->channels = getle(b + 12, 4);
+		h->size = sizeof(float) * getle(b + 16, 8);
+		h->blk = getle(b + 24, 4);
+		h->offset = getle(b + 32, 8);
+		/* blocks tile the chunks of the buffer */
+		return h->rate > 0 && h->channels > 0 && h->blk > 0 &&
+			h->blk <= CHUNK && !(h->blk & (h->blk - 1)) &&
+			h->offset >= PACKHDR && h->offset <= fsize ? Pack : -1;
+	}
+	if (readall(fd, b, 12, 0) < 12 || memcmp(b + 8, "WAVE", 4) ||
+			(memcmp(b, "RIFF", 4) && memcmp(b, "RF64", 4)))
+		return Raw;
+	rf64 = !memcmp(b, "RF64", 4);
+	for (pos = 12; pos + 8 <= (uint64_t)fsize; pos += 8 + len + (len & 1)) {
+		if (readall(fd, b, 8, pos) < 8)
+			break;
+		len = getle(b + 4, 4);
+		if (!memcmp(b, "ds64", 4) && readall(fd, b, 16, pos + 8) == 16) {
+			ds64 = getle(b + 8, 8);
+		} else if (!memcmp(b, "fmt ", 4) && len >= 16 &&
+				readall(fd, b, MIN(len, sizeof(b)), pos + 8) >= 16) {
+			tag = getle(b, 2);
+			h->channels = getle(b + 2, 2);
+			h->rate = getle(b + 4, 4);
+			bits = getle(b + 14, 2);
+			if (tag == 0xfffe && len >= 26) /* extensible, the tag starts
+			                                 * the subformat */
+				tag = getle(b + 24, 2);
+		} else if (!memcmp(b, "data", 4)) {
+			/* samples run to the end of a truncated recording */
+			h->offset = pos + 8;
+			h->size = rf64 && len == 0xffffffff ? ds64 : len;
+			h->size = MIN(h->size, (uint64_t)(fsize - h->offset));
+			if (bits == 8 && tag == 1)
+				snprintf(name, sizeof(name), "u8");
+			else
+				snprintf(name, sizeof(name), "%c%dle", tag == 3 ? 'f' : 's', bits);
+			h->codec = codecfind(name);
+			return (tag == 1 || tag == 3) && h->codec != NULL &&
+				8 * h->codec->size == (size_t)bits &&
+				h->rate > 0 && h->channels > 0 ? Riff : -1;
+		}
+	}
+	return -1;
+}
+
+/* the wave in filename, or -1 and why it could not be opened */
+static int
+readwave(Wave *ret, char *filename, const Codec *codec, int sampleRate,
+		int channels, char prec, char async)
+{
+	int fd; /* wave file descriptor */
+	struct stat st;
+	Header h;
+	Piece p;
+	size_t skew, i, n;
+	uint64_t *seek;
+
+	if ((fd = open(filename, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+		printf("err: unable to open %s: %s\n", filename, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	/* a wav or med header has the last word over the flags */
+	h.codec = codec;
+	h.rate = sampleRate;
+	h.channels = channels;
+	h.offset = 0;
+	h.blk = 0;
+	h.size = st.st_size;
+	if ((ret->head = readheader(fd, st.st_size, &h)) < 0) {
+		printf("err: %s: unsupported or broken header\n", filename);
+		close(fd);
+		return -1;
+	}
+
+	/* the wave keeps a name of its own, freed by freewave() */
+	if ((ret->name = strdup(filename)) == NULL)
+		die("strdup:");
+	ret->piece = NULL;
+	ret->npieces = 0;
+	ret->wsize = h.size / h.codec->size;
+	ret->codec = codec = h.codec;
+	ret->modificated = 0;
+	ret->planar = 0;
+	ret->prec = prec;
+	ret->sampleRate = h.rate ? h.rate : 48000;
+	ret->channels = h.channels ? h.channels : 2;
+	ret->leftSelection = ret->rightSelection = -1;
+	ret->ops = NULL;
+	ret->nops = 0;
+	ret->undo = ret->redo = NULL;
+	ret->nundo = ret->nredo = 0;
+	ret->load = NULL;
+
+	if (!ret->wsize) {
+		close(fd);
+		return 0;
+	}
+
+	/* nothing is read here: chunks are brought in when a command first
+	 * touches them, and paged back out under the -m budget */
+	p.buf = bufnew(ret->wsize, fd, h.offset, codec);
+	p.buf->prec = prec;
+	p.off = 0;
+	p.len = ret->wsize;
+
+	/* packed blocks are found through the seek table after them */
+	if (ret->head == Pack) {
+		n = (ret->wsize + h.blk - 1) / h.blk + 1;
+		seek = p.buf->seek = ecalloc(n, sizeof(*seek));
+		p.buf->blk = h.blk;
+		p.buf->channels = ret->channels;
+		if (readall(fd, seek, sizeof(*seek) * n, h.offset) < sizeof(*seek) * n)
+			goto broken;
+		for (i = 0; i < n; ++i) {
+			seek[i] = getle((unsigned char *)(seek + i), 8);
+			if (i ? seek[i] < seek[i - 1] || seek[i] - seek[i - 1] >
+					PACKMAX(h.blk) : seek[i] != PACKHDR)
+				goto broken;
+		}
+		if (seek[n - 1] > (uint64_t)h.offset)
+			goto broken;
+	}
+
+	/* floats in host byte order live in a private mapping, sharing pages
+	 * with the page cache until an edit writes to them; other formats
+	 * are decoded chunk by chunk */
+	if (ret->head != Pack && codecnative(codec) && prec == PrecF32 &&
+			h.offset % sizeof(float) == 0) {
+		skew = h.offset % sysconf(_SC_PAGESIZE);
+		p.buf->mapsize = skew + sizeof(float) * ret->wsize;
+		if ((p.buf->mapbase = mmap(NULL, p.buf->mapsize,
+						PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_NORESERVE,
+						fd, h.offset - skew)) == MAP_FAILED) {
+			printf("err: unable to map %s: %s\n", filename, strerror(errno));
+			bufrelease(p.buf);
+			free(ret->name);
+			return -1;
+		}
+		p.buf->map = (float *)((char *)p.buf->mapbase + skew);
+	}
+	pieceinsert(ret, 0, &p, 1);
+
+	/* the peak pyramid comes from the sidecar left by an earlier open or
+	 * save when it still matches the file, and is built and left there
+	 * otherwise, unless it was built over rounded samples; an async
+	 * open leaves both to a loader thread */
+	if (async) {
+		ret->load = loadstart(p.buf, filename, codec, &st, prec == PrecF32);
+	} else if (!peakload(p.buf, filename, &st)) {
+		bufpeakfresh(p.buf, 0, ret->wsize);
+		if (prec == PrecF32)
+			peakstore(p.buf->peak[0], p.buf->npeak[0], filename, codec);
+	}
+	return 0;
+
+broken:
+	printf("err: %s: broken seek table\n", filename);
+	bufrelease(p.buf);
+	free(ret->name);
+	return -1;
+}
+
+/* riff, or rf64 past 4 GiB, with the ds64 chunk kept as junk in riff
+ * so every header has the same size */
+static size_t
+riffheader(unsigned char *h, const Codec *codec, int rate, int channels,
+		uint64_t size)
+{
+	uint64_t riff = 72 + size + (size & 1);
+	int big = riff > 0xffffffff;
+
+	memcpy(h, big ? "RF64" : "RIFF", 4);
+	putle(h + 4, big ? 0xffffffff : riff, 4);
+	memcpy(h + 8, "WAVE", 4);
+	memcpy(h + 12, big ? "ds64" : "JUNK", 4);
+	putle(h + 16, 28, 4);
+	memset(h + 20, 0, 28);
+	if (big) {
+		putle(h + 20, riff, 8);
+		putle(h + 28, size, 8);
+		putle(h + 36, size / codec->size / channels, 8);
+	}
+	memcpy(h + 48, "fmt ", 4);
+	putle(h + 52, 16, 4);
+	putle(h + 56, codec->type == CodecFloat ? 3 : 1, 2);
+	putle(h + 58, channels, 2);
+	putle(h + 60, rate, 4);
+	putle(h + 64, (uint64_t)rate * channels * codec->size, 4);
+	putle(h + 68, channels * codec->size, 2);
+	putle(h + 70, 8 * codec->size, 2);
+	memcpy(h + 72, "data", 4);
+	putle(h + 76, big ? 0xffffffff : size, 4);
+	return 80;
+}
+
+static void
+savewave(char *filename, Wave wave, const Codec *codec, char sidecar)
+{
+	static unsigned char *stage = NULL; /* reused between saves */
+	static float *frames = NULL;        /* a planar wave interleaved */
+	uint32_t dither[DITHERLANES];
+	const float *src;
+	char *tmp;
+	int fd;
+	size_t pos, n, i, m, hsize = 0;
+	uint64_t size = (uint64_t)codec->size * wave.wsize;
+	Peak *pk = NULL, t, *d;
+	struct stat st;
+	mode_t mask;
+	Pin pin;
+	int err;
+
+	/* the wave is written next to its destination and renamed over it,
+	 * so an interrupted save never leaves a half written file behind and
+	 * a wave mapped from filename stays valid while it is rewritten */
+	if ((tmp = malloc(strlen(filename) + 8)) == NULL)
+		die("malloc:");
+	sprintf(tmp, "%s.XXXXXX", filename);
+	if ((fd = mkstemp(tmp)) < 0)
+		die("unable to open %s:", tmp);
+	if (stat(filename, &st) == 0)
+		fchmod(fd, st.st_mode & 07777);
+	else
+		mask = umask(0), umask(mask), fchmod(fd, 0666 & ~mask);
+
+	if (stage == NULL && posix_memalign((void **)&stage, 64, 8 * WRITEBUF))
+		die("posix_memalign:");
+	if (wave.planar && frames == NULL &&
+			posix_memalign((void **)&frames, 64, sizeof(float) * WRITEBUF))
+		die("posix_memalign:");
+	/* the whole file is allocated first, so a full disk fails the save
+	 * before anything is written, then the header goes out in one write;
+	 * the size of a packed one is only known at the end */
+	if (wave.head == Riff)
+		hsize = riffheader(stage, codec, wave.sampleRate, wave.channels, size);
+	if (wave.head != Pack && hsize + size && (err = posix_fallocate(fd, 0,
+					hsize + size + (wave.head == Riff && size & 1))) == ENOSPC) {
+		unlink(tmp);
+		errno = err;
+		die("unable to save %s:", filename);
+	}
+	writeall(fd, stage, hsize, tmp);
+	for (i = 0; i < DITHERLANES; ++i) /* the same dither on every save */
+		dither[i] = 0x9e3779b9 * (i + 1);
+	/* peaks taken before encoding only match formats that keep floats */
+	if (sidecar && codec->type == CodecFloat)
+		pk = arenaget((wave.wsize + PEAKBLK - 1) / PEAKBLK, sizeof(*pk));
+	if (wave.head == Pack)
+		packsave(fd, &wave, tmp, pk);
+	for (pos = 0; wave.head != Pack && pos < wave.wsize; pos += n) {
+		n = wave.wsize - pos;
+		if (wave.planar) {
+			n = MIN(n, WRITEBUF);
+			waveread(&wave, pos, n, frames);
+			src = frames;
+		} else { /* pinned, a loader may be paging meanwhile */
+			src = wavepin(&wave, pos, &n, 0, &pin);
+		}
+		if (!codecnative(codec))
+			n = MIN(n, WRITEBUF);
+		for (i = 0; pk != NULL && i < n; i += m) {
+			m = MIN(n - i, PEAKBLK - (pos + i) % PEAKBLK);
+			peakscan(src + i, m, &t);
+			d = pk + (pos + i) / PEAKBLK;
+			if ((pos + i) % PEAKBLK) {
+				d->min = MIN(d->min, t.min);
+				d->max = MAX(d->max, t.max);
+				d->sq += t.sq;
+			} else {
+				*d = t;
+			}
+		}
+		if (codecnative(codec)) {
+			writeall(fd, src, sizeof(float) * n, tmp);
+		} else {
+			codec->encode(codec, stage, src, n, dither);
+			writeall(fd, stage, codec->size * n, tmp);
+		}
+		if (!wave.planar)
+			waveunpin(&pin);
+	}
+	if (wave.head == Riff && size & 1) /* chunks are padded to even sizes */
+		writeall(fd, "", 1, tmp);
+
+	if (syncwrites && fsync(fd) < 0)
+		die("unable to sync %s:", tmp);
+	if (close(fd) < 0 || rename(tmp, filename) < 0)
+		die("unable to save %s:", filename);
+	free(tmp);
+	if (pk != NULL)
+		peakstore(pk, (wave.wsize + PEAKBLK - 1) / PEAKBLK, filename, codec);
+}
+
+static void
+selectwave(Wave *waves, size_t waven, int *selwav, char *l)
+{
+	*selwav = strtol(++l, NULL, 10);
+	if (*selwav >= waven)
+		printf("wave [%d] doesn't exist, unselecting\n",
+				*selwav), *selwav = -1;
+}
+
+static void
+shell(Wave **waves, size_t *waven)
+{
+	char *l; size_t lsiz = 0;
+	ssize_t lsizr = 0;
+	int selwav = -1;
+	size_t i;
+	Stat a, b;
+
+	l = malloc(lsiz);
+	printf(":");
+	for (;;) {
+#ifdef XVIEW
+		viewwait(*waves, *waven, selwav);
+#endif
+		if ((lsizr = getline(&l, &lsiz, stdin)) <= 0)
+			break;
+		if (l[lsizr - 1] == '\n') l[lsizr - 1] = '\0';
+		statsample(&a);
+		for (i = 0; i < *waven; ++i)
+			loadfree(&(*waves)[i], LoadPoll);
+		if (selwav >= 0 && (*l == 'i' || *l == 'p' || *l == 'w'))
+			applywave(*waves, *waven, &(*waves)[selwav]);
+		switch (*l) {
+		case '#': /* comment */
+			break;
+		case ':': /* command */
+			docommand(waves, waven, &selwav, l + 1);
+			break;
+		case 'e': /* edit */
+			editwave(waves, waven, *(l + 1) == ' ' ?
+					l + 2 : l + 1); break;
+		case 'i': /* info */
+			if (selwav < 0)
+				puts("err: no selected wave");
+			else
+				printwaveinfo((*waves)[selwav]);
+			break;
+		case 'l': /* list */
+			printwavelist(*waves, *waven); break;
+		case 'n': /* new */
+			newwave(waves, waven, *(l + 1) == ' ' ?
+					l + 2 : l + 1); break;
+		case 'p': /* play wave */
+			if (selwav < 0)
+				puts("err: no selected wave");
+			else
+				playwave((*waves)[selwav]);
+			break;
+		case 's': /* select wave */
+			selectwave(*waves, *waven, &selwav, l); break;
+		case 'w': /* write */
+			if (selwav < 0)
+				puts("err: no selected wave");
+			else
+				writewave((*waves)[selwav], l + 1);
+			break;
+		case 'q': /* quit */
+			goto stop; break;
+#ifdef XVIEW
+		case 'v': /* show the view again */
+			XMapRaised(view.dpy, view.win); break;
+#endif
+		case 'u': /* undo */
+		case 'U': /* redo */
+			if (selwav < 0)
+				puts("err: no selected wave");
+			else if (*l == 'u')
+				waveundo(&((*waves)[selwav]));
+			else
+				waveredo(&((*waves)[selwav]));
+			break;
+		case 'L': /* left selection change */
+		case 'R': /* right selection change */
+			if (selwav < 0)
+				puts("err: no selected wave");
+			else
+				changewavselection(&((*waves)[selwav]), *l == 'R', l + 1);
+			break;
+		default:
+			puts("?"); break;
+		}
+		if (*l && *l != '#') {
+			statsample(&b);
+			statrecord(l, &a, &b);
+		}
+		arenareset();
+		if (selwav != -1)
+			printf("[wave: %d]:", selwav);
+		else
+			printf(":");
+	}
+
+	puts("");
+	stop:
+	free(l);
+}
+
+/* what a shell command cost between the samples a and b; cpu time above
+ * the wall time is workers running at once, far below it is waiting on
+ * files, pipes or faults of mapped waves */
+static void
+statrecord(const char *cmd, const Stat *a, const Stat *b)
+{
+	Stat *s;
+
+	if ((stats = realloc(stats, sizeof(Stat) * (nstats + 1))) == NULL)
+		die("realloc:");
+	s = &stats[nstats++];
+	snprintf(s->cmd, sizeof(s->cmd), "%s", cmd);
+	s->wall = b->wall - a->wall;
+	s->cpu = b->cpu - a->cpu;
+	s->touched = b->touched - a->touched;
+	s->read = b->read - a->read;
+	s->written = b->written - a->written;
+	s->allocs = b->allocs - a->allocs;
+	s->faults = b->faults - a->faults;
+	s->rss = b->rss - a->rss;
+	if (verbose)
+		fprintf(stderr, "%s: %.3fs wall, %.3fs cpu, %.1fMB touched, "
+				"%.1fMB read, %.1fMB written, %ld faults, %lu allocs, "
+				"%+ldkB rss\n", s->cmd, s->wall, s->cpu, s->touched / 1e6,
+				s->read / 1e6, s->written / 1e6, s->faults,
+				(unsigned long)s->allocs, s->rss);
+}
+
+/* the counters as they are now */
+static void
+statsample(Stat *s)
+{
+	struct timespec t;
+	struct rusage ru;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	getrusage(RUSAGE_SELF, &ru);
+	s->wall = t.tv_sec + t.tv_nsec * 1e-9;
+	s->cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6 +
+		ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+	s->touched = __atomic_load_n(&touchbytes, __ATOMIC_RELAXED);
+	s->read = __atomic_load_n(&readbytes, __ATOMIC_RELAXED);
+	s->written = __atomic_load_n(&writebytes, __ATOMIC_RELAXED);
+	s->allocs = __atomic_load_n(&nallocs, __ATOMIC_RELAXED);
+	s->faults = ru.ru_majflt;
+	s->rss = ru.ru_maxrss;
+}
+
+/* the pending edits in one pass: the span they cover is cut where any
+ * of them starts or ends, and each tile of a cut goes through all the
+ * edits over it in order while it is in cache */
+static void
+waveapply(Wave *wave)
+{
+	size_t n = wave->nops, *cut, i, k, m;
+	Gain *g, **on;
+	Op *op = wave->ops;
+
+	if (!n)
+		return;
+	g = arenaget(n, sizeof(*g));
+	on = arenaget(n + 1, sizeof(*on));
+	cut = arenaget(2 * n, sizeof(*cut));
+	for (i = 0; i < n; ++i) {
+		g[i].g = op[i].g;
+		g[i].limit = op[i].limit;
+		pthread_mutex_init(&g[i].lock, NULL);
+		for (k = 2 * i; k > 0 && cut[k - 1] > op[i].l; --k)
+			cut[k] = cut[k - 1];
+		cut[k] = op[i].l;
+		for (k = 2 * i + 1; k > 0 && cut[k - 1] > op[i].r; --k)
+			cut[k] = cut[k - 1];
+		cut[k] = op[i].r;
+	}
+	for (i = 0; i + 1 < 2 * n; ++i) {
+		for (m = 0, k = 0; k < n; ++k)
+			if (op[k].l <= cut[i] && cut[i + 1] <= op[k].r)
+				on[m++] = &g[k];
+		on[m] = NULL;
+		if (m && cut[i] < cut[i + 1])
+			wavemap(wave, cut[i], cut[i + 1], waveapplykern, on);
+	}
+
+	/* levels as they came out of each gain, before any limiting */
+	for (i = 0; i < n; ++i) {
+		printf("peak: %f (%.2f dBFS), clipped: %lu samples%s\n",
+				g[i].peak, 20 * log10f(g[i].peak),
+				(unsigned long)g[i].clipped,
+				g[i].limit == LimitHard ? ", hard limited" :
+				g[i].limit == LimitSoft ? ", soft limited" : "");
+		pthread_mutex_destroy(&g[i].lock);
+	}
+	free(wave->ops);
+	wave->ops = NULL;
+	wave->nops = 0;
+}
+
+static void
+waveapplykern(void *arg, float *p, size_t n)
+{
+	Gain **g;
+	for (g = arg; *g; ++g)
+		wavevolumekern(*g, p, n);
+}
+
+/* n samples of silence for an empty wave, a buffer for each channel
+ * when it is planar */
+static void
+waveblank(Wave *wave, size_t n)
+{
+	size_t ch = MAX(wave->channels, 1), c;
+	Piece p;
+	p.off = 0;
+	for (c = 0; n && c < (wave->planar ? ch : 1); ++c) {
+		p.len = wave->planar ? n / ch : n;
+		p.buf = bufnew(p.len, -1, 0, 0);
+		p.buf->prec = wave->prec;
+		pieceinsert(wave, wave->npieces, &p, 1);
+	}
+	wave->wsize = n;
+}
+
+static void
+waveconv(Wave *wave, Conv **cv, size_t delay)
+{
+	ConvJob j;
+	size_t ch = MAX(wave->channels, 1), l, r, len, end, t, c, f, got, oa, oe;
+
+	waverange(wave, &l, &r);
+	l /= ch;
+	len = r / ch - l;
+	end = len ? len + delay : 0;
+	j.cv = cv;
+	j.ch = ch;
+	j.in = arenaget(ch, sizeof(*j.in));
+	for (c = 0; c < ch; ++c)
+		j.in[c] = arenaget(CONVBATCH, sizeof(float));
+	j.out = arenaget(ch * CONVBATCH, sizeof(float));
+
+	wavesnap(wave);
+	/* the output runs delay frames behind the input, so a batch only
+	 * writes over frames an earlier batch has already read */
+	for (t = 0; t < end; t += j.n) {
+		j.n = MIN(CONVBATCH, (end - t + CONVBLK - 1) / CONVBLK * CONVBLK);
+		if ((got = t < len ? MIN(j.n, len - t) : 0))
+			waveread(wave, ch * (l + t), ch * got, j.out);
+		for (c = 0; c < ch; ++c)
+			for (f = 0; f < j.n; ++f)
+				j.in[c][f] = f < got ? j.out[ch * f + c] : 0;
+		poolrun(waveconvtile, &j, ch);
+		oa = MAX(t, delay) - delay;
+		oe = t + j.n > delay ? MIN(t + j.n - delay, len) : 0;
+		if (oa < oe)
+			wavewrite(wave, ch * (l + oa), ch * (oe - oa),
+					j.out + ch * (oa + delay - t));
+	}
+	wave->modificated = 1;
+}
+
+/* an impulse response from a wave file, with a channel for each channel
+ * of the wave or one for all of them, brought to the wave's rate; raw
+ * files are taken at the wave's rate and channels */
+static void
+waveconvfile(Wave *wave, char *l)
+{
+	const Resampler *r = NULL;
+	struct stat st;
+	Wave ir;
+	Conv **cv;
+	size_t ch = MAX(wave->channels, 1), ich, frames, len, c, f;
+	int64_t a = 0, e;
+	float *s, *x, *h;
+
+	if (stat(l, &st) < 0 || !S_ISREG(st.st_mode)) {
+		printf("err: unable to open %s\n", l);
+		return;
+	}
+	if (readwave(&ir, l, defcodec, wave->sampleRate, ch, PrecF32, 0) < 0)
+		return;
+	ich = MAX(ir.channels, 1);
+	if (ich != 1 && ich != ch) {
+		printf("err: impulse response has %d channels, wave has %d\n",
+				ir.channels, wave->channels);
+		freewave(&ir);
+		return;
+	}
+	frames = ir.wsize / ich;
+	s = arenaget(MAX(ich * frames, 1), sizeof(float));
+	waveread(&ir, 0, ich * frames, s);
+	len = e = frames;
+	if (ir.sampleRate != wave->sampleRate) {
+		if ((r = resampler(ir.sampleRate, wave->sampleRate)) == NULL)
+			die("malloc:");
+		len = (frames * r->up + r->down - 1) / r->down;
+		resamplespan(r, 0, MAX(len, 1), &a, &e);
+	}
+	x = arenaget(e - a, sizeof(float));
+	h = r ? arenaget(MAX(len, 1), sizeof(float)) : x;
+	cv = arenaget(ch, sizeof(*cv));
+	for (c = 0; c < ch; ++c) {
+		if (c < ich) {
+			for (f = 0; (int64_t)f < e - a; ++f)
+				x[f] = a + (int64_t)f < 0 || a + (int64_t)f >= (int64_t)frames ?
+					0 : s[ich * (a + f) + c];
+			/* the area under the response stays, whatever the rate */
+			if (r) {
+				resample(r, x, a, 0, len, h, 1);
+				for (f = 0; f < len; ++f)
+					h[f] *= (float)ir.sampleRate / wave->sampleRate;
+			}
+		}
+		if ((cv[c] = convnew(h, len, CONVBLK)) == NULL)
+			die("malloc:");
+	}
+	freewave(&ir);
+
+	waveconv(wave, cv, 0);
+	for (c = 0; c < ch; ++c)
+		convfree(cv[c]);
+}
+
+static void
+waveconvtile(void *arg, size_t i)
+{
+	ConvJob *j = arg;
+	size_t f;
+	for (f = 0; f < j->n; f += CONVBLK)
+		convblock(j->cv[i], j->in[i] + f, j->in[i] + f);
+	for (f = 0; f < j->n; ++f)
+		j->out[j->ch * f + i] = j->in[i][f];
+}
+
+static void
+wavecopy(Wave *wave)
+{
+	size_t ch = MAX(wave->channels, 1), l, r, a, b, c;
+	waverange(wave, &l, &r);
+	freewave(&clip);
+	/* a planar wave gives a planar clip, the selection of each channel
+	 * in turn */
+	for (c = 0; c < (wave->planar ? ch : 1); ++c) {
+		a = piecesplit(wave, waveplane(wave, c, l));
+		b = piecesplit(wave, waveplane(wave, c, r));
+		pieceinsert(&clip, clip.npieces, wave->piece + a, b - a);
+		for (; a < b; ++a)
+			++wave->piece[a].buf->refs;
+	}
+	clip.wsize = r - l;
+	clip.channels = wave->channels;
+	clip.planar = wave->planar;
+	clip.prec = wave->prec;
+}
+
+static void
+wavecut(Wave *wave)
+{
+	wavecopy(wave);
+	wavedelete(wave);
+}
+
+static void
+wavedelete(Wave *wave)
+{
+	size_t ch = MAX(wave->channels, 1), l, r, a, c;
+	wavesnap(wave);
+	waverange(wave, &l, &r);
+	/* the last channel first, the ones before keep their positions */
+	for (c = wave->planar ? ch : 1; c-- > 0; ) {
+		a = piecesplit(wave, waveplane(wave, c, l));
+		pieceremove(wave, a, piecesplit(wave, waveplane(wave, c, r)) - a);
+	}
+	wave->wsize -= r - l;
+	wave->rightSelection = l;
+	wave->modificated = 1;
+}
+
+static void
+snaprestore(Snap *s, Wave *wave)
+{
+	pieceremove(wave, 0, wave->npieces);
+	free(wave->piece);
+	wave->piece = s->piece;
+	wave->npieces = s->npieces;
+	wave->wsize = s->wsize;
+	wave->leftSelection = s->leftSelection;
+	wave->rightSelection = s->rightSelection;
+	wave->sampleRate = s->sampleRate;
+	wave->planar = s->planar;
+	wave->prec = s->prec;
+	free(wave->ops);
+	wave->ops = s->ops;
+	wave->nops = s->nops;
+	wave->modificated = s->modificated;
+}
+
+/* a whole chunk whatever its length, as the budget charges; slots are
+ * on cache lines, so are the planes of a planar wave, and on huge pages
+ * where there are any; storelock is held or the workers are idle */
+static void *
+slabget(int prec)
+{
+	struct Slab *s = &slabs[PRECSIZE(prec) / 4];
+	size_t size = PRECSIZE(prec) * CHUNK;
+	void *c;
+
+	++s->used;
+	if (s->nfree)
+		return s->free[--s->nfree];
+	if (posix_memalign(&c, SLABALIGN, size))
+		die("posix_memalign:");
+#ifdef MADV_HUGEPAGE
+	madvise(c, size, MADV_HUGEPAGE);
+#endif
+	++s->reserved;
+	COUNT(nallocs, 1);
+	return c;
+}
+
+static void
+slabput(int prec, void *c)
+{
+	struct Slab *s = &slabs[PRECSIZE(prec) / 4];
+
+	--s->used;
+	if (s->nfree < SLABKEEP) {
+		s->free[s->nfree++] = c;
+		return;
+	}
+	free(c);
+	--s->reserved;
+}
+
+static void
+snaptake(Snap *s, Wave *wave)
+{
+	size_t i;
+	s->piece = NULL;
+	if (wave->npieces && (s->piece = malloc(sizeof(Piece) * wave->npieces)) == NULL)
+		die("malloc:");
+	for (i = 0; i < wave->npieces; ++i)
+		++(s->piece[i] = wave->piece[i]).buf->refs;
+	s->npieces = wave->npieces;
+	s->wsize = wave->wsize;
+	s->leftSelection = wave->leftSelection;
+	s->rightSelection = wave->rightSelection;
+	s->sampleRate = wave->sampleRate;
+	s->planar = wave->planar;
+	s->prec = wave->prec;
+	s->ops = NULL;
+	if (wave->nops && (s->ops = malloc(sizeof(Op) * wave->nops)) == NULL)
+		die("malloc:");
+	if (wave->nops)
+		memcpy(s->ops, wave->ops, sizeof(Op) * wave->nops);
+	s->nops = wave->nops;
+	s->modificated = wave->modificated;
+	s->cost = 0;
+	s->stamp = ++snapclock;
+}
+
+static void
+wavedump(Wave wave)
+{
+	size_t pos, n, i;
+	float p[TILE];
+	for (pos = 0; pos < wave.wsize; pos += n) {
+		n = MIN(wave.wsize - pos, TILE);
+		waveread(&wave, pos, n, p);
+		for (i = 0; i < n; ++i)
+			printf("[%6lu]: %f\n", (unsigned long)(pos + i), p[i]);
+	}
+}
+
+/* biquads apart by commas, each a type and its fields apart by slashes:
+ * lp, hp, bp and notch take <hz>[/<q>], pk, ls and hs <hz>/<db>[/<q>];
+ * the frames go through in order, channels side by side */
+static void
+waveeq(Wave *wave, char *l)
+{
+	static const struct {
+		const char *name;
+		char db;  /* takes a gain */
+		double q; /* unless given */
+	} types[] = {
+		[EqLow] = { "lp", 0, M_SQRT1_2 }, [EqHigh] = { "hp", 0, M_SQRT1_2 },
+		[EqBand] = { "bp", 0, 1 }, [EqNotch] = { "notch", 0, 10 },
+		[EqPeak] = { "pk", 1, 1 }, [EqLowShelf] = { "ls", 1, M_SQRT1_2 },
+		[EqHighShelf] = { "hs", 1, M_SQRT1_2 },
+	};
+	size_t ch = MAX(wave->channels, 1), type, nv, n, a, r, len, t;
+	double v[3], nyq = wave->sampleRate / 2.0, Q;
+	Biquad q[EQMAX];
+	char *p, *e;
+	EqJob j;
+
+	for (j.nq = 0, p = l; j.nq == 0 || *p; ++j.nq) {
+		if (j.nq == EQMAX) {
+			printf("err: more than %d biquads\n", EQMAX);
+			return;
+		}
+		for (type = 0; type < LENGTH(types); ++type)
+			if (!strncmp(p, types[type].name, n = strlen(types[type].name)) &&
+					p[n] == '/')
+				break;
+		if (type == LENGTH(types))
+			goto bad;
+		for (p += n, nv = 0; *p == '/' && nv < LENGTH(v); ++nv, p = e) {
+			v[nv] = strtod(p + 1, &e);
+			if (e == p + 1)
+				goto bad;
+		}
+		if ((*p != '\0' && *p != ',') || nv < 1u + types[type].db ||
+				nv > 2u + types[type].db)
+			goto bad;
+		Q = nv == 2u + types[type].db ? v[nv - 1] : types[type].q;
+		if (!(v[0] > 0 && v[0] < nyq) || !(Q > 0))
+			goto bad;
+		biquaddesign(&q[j.nq], type, v[0] / wave->sampleRate,
+				types[type].db ? v[1] : 0, Q);
+		if (*p == ',')
+			++p;
+	}
+
+	waverange(wave, &a, &r);
+	a /= ch;
+	len = r / ch - a;
+	j.q = q;
+	j.ch = ch;
+	j.p = arenaget(ch * EQBATCH, sizeof(float));
+	j.state = arenaget((ch + EQLANES - 1) / EQLANES * 2 * EQLANES * j.nq,
+			sizeof(double));
+	wavesnap(wave);
+	for (t = 0; t < len; t += j.n) {
+		j.n = MIN(EQBATCH, len - t);
+		waveread(wave, ch * (a + t), ch * j.n, j.p);
+		poolrun(waveeqtile, &j, (ch + EQLANES - 1) / EQLANES);
+		wavewrite(wave, ch * (a + t), ch * j.n, j.p);
+	}
+	wave->modificated = 1;
+	return;
+bad:
+	printf("err: bad eq: %s\n", l);
+}
+
+static void
+waveeqtile(void *arg, size_t i)
+{
+	EqJob *j = arg;
+	biquad(j->p + EQLANES * i, j->n, j->ch, MIN(EQLANES, j->ch - EQLANES * i),
+			j->q, j->nq, j->state + 2 * EQLANES * j->nq * i);
+}
+
+/* lp/<hz>, hp/<hz>, bp/<lo>/<hi> or bs/<lo>/<hi>, then the taps if not
+ * FIRTAPS; the filter is linear phase and its delay is taken out */
+static void
+wavefir(Wave *wave, char *l)
+{
+	static const char *types[] = {
+		[FirLow] = "lp/", [FirHigh] = "hp/", [FirBand] = "bp/", [FirStop] = "bs/",
+	};
+	size_t ch = MAX(wave->channels, 1), type, i, c;
+	double fc[2] = { 0, 0 }, nyq = wave->sampleRate / 2.0;
+	long taps = FIRTAPS;
+	char *p, *e;
+	Conv **cv;
+	float *h;
+
+	for (type = 0; type < LENGTH(types) && strcmpt(types[type], l, '/'); ++type)
+		;
+	if (type == LENGTH(types)) {
+		printf("err: unknown filter: %s\n", l);
+		return;
+	}
+	for (p = l + 3, i = 0; i < (type == FirBand || type == FirStop ? 2 : 1); ++i) {
+		fc[i] = strtod(p, &e);
+		if (e == p || (*e != '\0' && *e != '/'))
+			goto bad;
+		p = *e ? e + 1 : e;
+	}
+	if (*p != '\0' && ((taps = strtol(p, &e, 10)) <= 0 || taps > 1L << 24 ||
+				*e != '\0'))
+		goto bad;
+	if (!(fc[0] > 0 && fc[0] < nyq) || (i == 2 && !(fc[1] > fc[0] && fc[1] < nyq)))
+		goto bad;
+	taps |= 1; /* odd, so the delay is a whole frame */
+
+	if ((h = firdesign(type, fc[0] / wave->sampleRate,
+					fc[1] / wave->sampleRate, taps)) == NULL)
+		die("malloc:");
+	cv = arenaget(ch, sizeof(*cv));
+	for (c = 0; c < ch; ++c)
+		if ((cv[c] = convnew(h, taps, CONVBLK)) == NULL)
+			die("malloc:");
+	free(h);
+	waveconv(wave, cv, taps / 2);
+	for (c = 0; c < ch; ++c)
+		convfree(cv[c]);
+	return;
+bad:
+	printf("err: bad filter: %s\n", l);
+}
+
+static void
+waveget(Wave *wave, size_t pos, size_t n, float *dst)
+{
+	size_t got;
+	float *p;
+	Pin pin;
+	for (; n; pos += got, dst += got, n -= got) {
+		got = n;
+		p = wavepin(wave, pos, &got, 0, &pin);
+		memcpy(dst, p, sizeof(float) * got);
+		waveunpin(&pin);
+	}
+}
+
+/* the samples of the wave copied into new buffers in another layout or
+ * precision, -1 if it is to be planar and is not whole frames */
+static int
+wavelayout(Wave *wave, char planar, char prec)
+{
+	size_t ch = MAX(wave->channels, 1), pos, n;
+	Wave out;
+	float *t;
+
+	if (wave->planar == planar && wave->prec == prec)
+		return 0;
+	if (planar && wave->wsize % ch)
+		return -1;
+	memset(&out, 0, sizeof(out));
+	out.channels = wave->channels;
+	out.planar = planar;
+	out.prec = prec;
+	waveblank(&out, wave->wsize);
+	t = arenaget(ch * LAYOUTBATCH, sizeof(float));
+	for (pos = 0; pos < wave->wsize; pos += n) {
+		n = MIN(wave->wsize - pos, ch * LAYOUTBATCH);
+		waveread(wave, pos, n, t);
+		wavewrite(&out, pos, n, t);
+	}
+	pieceremove(wave, 0, wave->npieces);
+	pieceinsert(wave, 0, out.piece, out.npieces);
+	free(out.piece);
+	wave->planar = planar;
+	wave->prec = prec;
+	return 0;
+}
+
+static void
+wavemap(Wave *wave, size_t l, size_t r,
+		void (*kern)(void *arg, float *p, size_t n), void *arg)
+{
+	size_t ch = MAX(wave->channels, 1), c;
+	MapJob j;
+	j.wave = wave;
+	j.kern = kern;
+	j.arg = arg;
+	/* the kernels do not tell channels apart, a planar wave is mapped
+	 * over the run of each channel in turn */
+	for (c = 0; c < (wave->planar ? ch : 1); ++c) {
+		j.l = waveplane(wave, c, l);
+		j.r = waveplane(wave, c, r);
+		waveprivate(wave, j.l, j.r);
+		poolrun(wavemaptile, &j, (j.r - j.l + TILE - 1) / TILE);
+	}
+}
+
+static void
+wavemaptile(void *arg, size_t i)
+{
+	MapJob *j = arg;
+	size_t pos = j->l + TILE * i, end = MIN(j->r, pos + TILE), n;
+	float *p;
+	Pin pin;
+	for (; pos < end; pos += n) {
+		n = end - pos;
+		p = wavepin(j->wave, pos, &n, 1, &pin);
+		j->kern(j->arg, p, n);
+		waveunpin(&pin);
+	}
+}
+
+static void
+wavepaste(Wave *wave)
+{
+	size_t ch = MAX(wave->channels, 1), l, r, a, i, c, ca, cb;
+	/* a clip in the other layout is brought to this one first */
+	if (clip.planar != wave->planar || (clip.planar &&
+				clip.channels != wave->channels)) {
+		if (!clip.planar)
+			clip.channels = wave->channels;
+		if (wavelayout(&clip, wave->planar, clip.prec) < 0 ||
+				(wave->planar && clip.channels != wave->channels)) {
+			puts("err: clip does not fit the wave's channels");
+			return;
+		}
+	}
+	wavesnap(wave);
+	waverange(wave, &l, &r);
+	for (c = wave->planar ? ch : 1; clip.wsize && c-- > 0; ) {
+		a = piecesplit(wave, waveplane(wave, c, l));
+		ca = wave->planar ? piecefind(&clip, waveplane(&clip, c, 0)) : 0;
+		cb = wave->planar && c + 1 < ch ?
+			piecefind(&clip, waveplane(&clip, c + 1, 0)) : clip.npieces;
+		pieceinsert(wave, a, clip.piece + ca, cb - ca);
+		for (i = ca; i < cb; ++i)
+			++clip.piece[i].buf->refs;
+	}
+	wave->wsize += clip.wsize;
+	wave->leftSelection = l;
+	wave->rightSelection = l + clip.wsize;
+	wave->modificated = 1;
+}
+
+static void
+waveredo(Wave *wave)
+{
+	Snap cur;
+	if (!wave->nredo) {
+		puts("err: nothing to redo");
+		return;
+	}
+	snaptake(&cur, wave);
+	cur.cost = wave->redo[wave->nredo - 1].cost;
+	snaprestore(&wave->redo[--wave->nredo], wave);
+	if ((wave->undo = realloc(wave->undo,
+					sizeof(Snap) * (wave->nundo + 1))) == NULL)
+		die("realloc:");
+	wave->undo[wave->nundo++] = cur;
+}
+
+/* the whole wave, a selection is kept over the same stretch of time */
+static void
+waveresample(Wave *wave, char *l)
+{
+	const Resampler *r;
+	ResampleJob j;
+	Wave out;
+	char *end;
+	long rate = strtol(l, &end, 10);
+	size_t ch = MAX(wave->channels, 1), frames = wave->wsize / ch, c, f;
+	size_t span;
+	int64_t a, e, ia, ie;
+	uint64_t nout;
+	float *stage;
 
-#define VERSION "0.1"
+	if (rate <= 0 || rate > INT_MAX || *end != '\0') {
+		printf("err: bad sample rate: %s\n", l);
+		return;
+	}
+	if (rate == wave->sampleRate)
+		return;
+	if ((r = resampler(wave->sampleRate, rate)) == NULL)
+		die("malloc:");
+	nout = (frames * r->up + r->down - 1) / r->down;
+	resamplespan(r, 0, RSBATCH, &a, &e);
+	span = e - a + 1;
 
-typedef struct {
-	char *name;
-	float *wave;
-	size_t wsize, leftSelection, rightSelection;
-	int sampleRate, channels;
-	char modificated;
-} Wave;
+	memset(&out, 0, sizeof(out));
+	out.channels = wave->channels;
+	out.planar = wave->planar;
+	out.prec = wave->prec;
+	waveblank(&out, ch * nout);
+	j.r = r;
+	j.ch = ch;
+	j.in = arenaget(ch, sizeof(*j.in));
+	for (c = 0; c < ch; ++c)
+		j.in[c] = arenaget(span, sizeof(float));
+	j.out = arenaget(ch * RSBATCH, sizeof(float));
+	stage = arenaget(ch * span, sizeof(float));
+	/* each batch is split up by channel and handed out in tiles, frames
+	 * before and after the wave read as silence */
+	for (j.k = 0; j.k < nout; j.k += j.n) {
+		j.n = MIN(RSBATCH, nout - j.k);
+		resamplespan(r, j.k, j.n, &j.a, &e);
+		ia = MAX(j.a, 0);
+		ie = MIN(e, (int64_t)frames);
+		if (ia < ie)
+			waveread(wave, ch * ia, ch * (ie - ia), stage);
+		for (c = 0; c < ch; ++c) {
+			for (f = 0; (int64_t)f < e - j.a; ++f)
+				j.in[c][f] = j.a + (int64_t)f < ia || j.a + (int64_t)f >= ie ?
+					0 : stage[ch * (j.a + f - ia) + c];
+		}
+		poolrun(waveresampletile, &j, ch * ((j.n + RSTILE - 1) / RSTILE));
+		wavewrite(&out, ch * j.k, ch * j.n, j.out);
+	}
 
-static void changewavselection(Wave *wave, char isRight, char *l);
-static void docommand(Wave **waves, size_t *waven, int *selwav, char *l);
-static void editwave(Wave **waves, size_t *waven, char *wname);
-static void newwave(Wave **waves, size_t *waven, char *wname);
-static void playwave(Wave wave);
-static void printwaveinfo(Wave wave);
-static void printwavelist(Wave *waves, size_t waven);
-static Wave readf32(char *filename, char endianness, int sampleRate, int channels);
-static void savef32(char *filename, Wave wave, char endianness);
-static void selectwave(Wave *waves, size_t waven, int *selwav, char *l);
-static void shell(Wave **waves, size_t *waven);
-static void wavedump(Wave wave);
-static void wavevolume(Wave *wave, char *l);
-static float wavelength(size_t wavesize, int sampleRate, int channels);
-static void wavereverse(Wave *wave);
-static void writewave(Wave wave, char *name);
-static void usage(void);
+	wavesnap(wave);
+	pieceremove(wave, 0, wave->npieces);
+	pieceinsert(wave, 0, out.piece, out.npieces);
+	free(out.piece);
+	if (wave->leftSelection != (size_t)-1)
+		wave->leftSelection = ch * ((uint64_t)(wave->leftSelection / ch) *
+				r->up / r->down);
+	if (wave->rightSelection != (size_t)-1)
+		wave->rightSelection = ch * ((uint64_t)(wave->rightSelection / ch) *
+				r->up / r->down);
+	wave->wsize = out.wsize;
+	wave->sampleRate = rate;
+	wave->modificated = 1;
+}
 
-#include "config.h"
-char *argv0;
+/* bytes of the wave's buffers and their parents held in memory, each
+ * buffer counted once */
+static size_t
+waveresident(Wave *wave)
+{
+	size_t nb = 0, bytes = 0, i, j, ci;
+	Buf **seen = NULL, *b;
+
+	pthread_mutex_lock(&storelock);
+	for (i = 0; i < wave->npieces; ++i) {
+		for (b = wave->piece[i].buf; b != NULL; b = b->parent) {
+			for (j = 0; j < nb && seen[j] != b; ++j)
+				;
+			if (j < nb)
+				continue;
+			if ((seen = realloc(seen, sizeof(*seen) * ++nb)) == NULL)
+				die("realloc:");
+			seen[nb - 1] = b;
+			for (ci = 0; ci < b->nchunks; ++ci)
+				if (b->chunk[ci] != NULL)
+					bytes += PRECSIZE(b->prec) * MIN(CHUNK, b->len - CHUNK * ci);
+		}
+	}
+	pthread_mutex_unlock(&storelock);
+	free(seen);
+	return bytes;
+}
 
 static void
-changewavselection(Wave *wave, char isRight, char *l)
+waveresampletile(void *arg, size_t i)
 {
-	size_t *val = isRight ? &(wave->rightSelection) : &(wave->leftSelection);
-	char secs = (l[strlen(l) - 1] == 's');
-	switch (*l) {
-	case '=': /* set to X number of samples/seconds */
-		*val = strtol(++l, NULL, 10) * wave->channels * (secs ? wave->sampleRate : 1);
-		break;
-	case '+': /* add X number of samples/seconds */
-		*val += strtol(++l, NULL, 10) * wave->channels * (secs ? wave->sampleRate : 1);
-		break;
-	case '-': /* remove X number of samples/seconds */
-		*val -= strtol(++l, NULL, 10) * wave->channels * (secs ? wave->sampleRate : 1);
-		break;
-	default:
-		printf("err: undefined char: %c\n", *l);
-		break;
+	ResampleJob *j = arg;
+	size_t c = i % j->ch, t = RSTILE * (i / j->ch);
+	resample(j->r, j->in[c], j->a, j->k + t, MIN(RSTILE, j->n - t),
+			j->out + j->ch * t + c, j->ch);
+}
+
+static float *
+wavepin(Wave *wave, size_t pos, size_t *n, char write, Pin *pin)
+{
+	Piece *p = wave->piece + piecefind(wave, pos);
+	size_t bpos;
+	void *c;
+
+	/* a span that is shared with another piece, the clipboard or a child
+	 * is never written to: it gets its own buffer filled from the old one
+	 * chunk by chunk as the writes reach it; workers only write to ranges
+	 * made private by waveprivate() beforehand */
+	if (write && p->buf->refs > 1)
+		piececow(p);
+	bpos = p->off + (pos - p->pos);
+	*n = MIN(*n, p->pos + p->len - pos);
+	*n = MIN(*n, CHUNK - bpos % CHUNK);
+	pin->b = p->buf;
+	pin->ci = bpos / CHUNK;
+	pin->tile = NULL;
+	c = bufchunk(p->buf, bpos / CHUNK, write, 1);
+	if (p->buf->prec == PrecF32) {
+		COUNT(touchbytes, sizeof(float) * *n);
+		return (float *)c + bpos % CHUNK;
+	}
+
+	/* compact samples are lent out as floats a tile at a time, the
+	 * written ones packed back as the pin is let go */
+	*n = MIN(*n, TILE);
+	pthread_mutex_lock(&storelock);
+	pin->tile = tiles.n ? tiles.t[--tiles.n] : NULL;
+	pthread_mutex_unlock(&storelock);
+	if (pin->tile == NULL) {
+		if (posix_memalign((void **)&pin->tile, 64, sizeof(float) * TILE))
+			die("posix_memalign:");
+		COUNT(nallocs, 1);
 	}
+	COUNT(touchbytes, PRECSIZE(p->buf->prec) * *n);
+	pin->c = c;
+	pin->off = bpos % CHUNK;
+	pin->n = *n;
+	pin->write = write;
+	bufunpack(p->buf, c, pin->off, *n, pin->tile);
+	return pin->tile;
+}
+
+/* where sample pos of the interleaved order is kept for channel c: frame
+ * pos / ch of the run of that channel in a planar wave, the runs one after
+ * another; pos itself in an interleaved one */
+static size_t
+waveplane(Wave *wave, size_t c, size_t pos)
+{
+	size_t ch = MAX(wave->channels, 1);
+	return wave->planar ? c * (wave->wsize / ch) + pos / ch : pos;
 }
 
 static void
-docommand(Wave **waves, size_t *waven, int *selwav, char *l)
+waveplanar(Wave *wave, char planar)
 {
-	if (*selwav < 0)
-		puts("err: no selected wave");
-	else if(!strcmp("dump", l))
-		wavedump((*waves)[*selwav]);
-	else if(!strcmp("rev", l))
-		wavereverse(&((*waves)[*selwav]));
-	else if(!strcmpt("vol/", l, '/'))
-		wavevolume(&((*waves)[*selwav]), l + 4);
-	else
-		puts("?");
+	if (wave->planar == planar)
+		return;
+	if (wave->wsize % MAX(wave->channels, 1)) {
+		puts("err: wave is not whole frames");
+		return;
+	}
+	wavesnap(wave);
+	wavelayout(wave, planar, wave->prec);
+	wave->modificated = 1;
 }
 
+/* rounded samples stay rounded when the wave is brought back to f32 */
 static void
-editwave(Wave **waves, size_t *waven, char *wname)
+waveprecision(Wave *wave, char *l)
 {
-	size_t ls = 0;
-	*waves = realloc(*waves, sizeof(Wave) * ++(*waven));
-	if (*wname == '\0')
-		printf("filename: "), ls = getline(&wname, &ls, stdin);
-	if (wname[ls - 1] == '\n') wname[ls - 1] = '\0';
-	(*waves)[(*waven) - 1] = readf32(wname, 0, 48000, 2);
-	(*waves)[(*waven) - 1].name = wname;
-	(*waves)[(*waven) - 1].leftSelection =
-		(*waves)[(*waven) - 1].rightSelection = -1;
-	(*waves)[(*waven) - 1].modificated = 0;
+	int prec;
+	if ((prec = precfind(l)) < 0) {
+		printf("err: unknown precision: %s\n", l);
+		return;
+	}
+	if (wave->prec == prec)
+		return;
+	wavesnap(wave);
+	wavelayout(wave, wave->planar, prec);
+	wave->modificated = 1;
 }
 
 static void
-newwave(Wave **waves, size_t *waven, char *wname)
+waveprivate(Wave *wave, size_t l, size_t r)
 {
-	size_t ls = 0, lr = 0;
-	*waves = realloc(*waves, sizeof(Wave) * ++(*waven));
-	if (*wname == '\0') {
-		printf("name [blank for default]: ");
-		if ((lr = getline(&wname, &ls, stdin)) < 2)
-			wname = "[no name]";
-		if (wname[lr - 1] == '\n') wname[lr - 1] = '\0';
+	size_t i;
+	if (l >= r)
+		return;
+	for (i = piecefind(wave, l); i < wave->npieces && wave->piece[i].pos < r; ++i)
+		if (wave->piece[i].buf->refs > 1)
+			piececow(&wave->piece[i]);
+}
+
+static void
+waveput(Wave *wave, size_t pos, size_t n, const float *src)
+{
+	size_t got;
+	float *p;
+	Pin pin;
+	for (; n; pos += got, src += got, n -= got) {
+		got = n;
+		p = wavepin(wave, pos, &got, 1, &pin);
+		memcpy(p, src, sizeof(float) * got);
+		waveunpin(&pin);
 	}
-	(*waves)[(*waven) - 1].name = calloc(strlen(wname), 0);
-	strncpy((*waves)[(*waven) - 1].name, wname, strlen(wname));
-	(*waves)[(*waven) - 1].sampleRate = 48000;
-	(*waves)[(*waven) - 1].channels = 2;
 }
 
 static void
-playwave(Wave wave)
+wavepeaks(Wave *wave, size_t l, size_t r, PeakSum *s, char coarse)
 {
-	char *wname, *cmd;
-	wname = calloc(strlen(wave.name) + 6 /* "/tmp/" = 5, plus null
-										   terminator = 6 */, 0);
-	cmd = calloc(BUFSIZ, 0);
-	free(cmd); /* this is really stupid, i don't know how it works,
-				  without calloc and freeing memory, with NULL as value
-				  of cmd, it crashes. After calloc and freeing allocated
-				  memory it works, when it should not. TODO */
-	strcat(wname, "/tmp/");
-	strcat(wname, wave.name);
-	strrep(wname + 5, '/', '_');
-	savef32(wname, wave, 0);
-	snprintf(cmd, BUFSIZ, "ffplay -autoexit -f f32le -ar %d -channels %d -showmode 0 %s 2> /dev/null",
-			wave.sampleRate, wave.channels, wname);
-	printf("playing: wave \"%s\" @ %dHz with %d channels\n",
-			wave.name, wave.sampleRate, wave.channels);
-	system(cmd);
-	unlink(wname);
-	free(wname);
+	size_t ch = MAX(wave->channels, 1), c;
+
+	s->min = INFINITY;
+	s->max = -INFINITY;
+	s->sq = 0;
+	pthread_mutex_lock(&peaklock);
+	for (c = 0; c < (wave->planar ? ch : 1); ++c)
+		wavepeakspan(wave, waveplane(wave, c, l), waveplane(wave, c, r),
+				s, coarse);
+	pthread_mutex_unlock(&peaklock);
+	if (s->min > s->max)
+		s->min = s->max = 0;
 }
 
 static void
-printwaveinfo(Wave wave)
+wavepeakspan(Wave *wave, size_t l, size_t r, PeakSum *s, char coarse)
 {
-	if (wave.name != NULL)
-		printf("\"%s\":\n\
-\tsample rate:      %d,\n\
-\tchannels:         %d,\n\
-\twave length:      %fs,\n\
-\tleft selection:  +%fs,\n\
-\tright selection: +%fs,\n\
-\tselection size:   %fs,\n\
-\tmodificated:      %s;\n",
-				wave.name, wave.sampleRate, wave.channels,
-				wavelength(wave.wsize, wave.sampleRate, wave.channels),
-				wave.leftSelection == -1 ? 0 :
-					wavelength(wave.leftSelection, wave.sampleRate, wave.channels),
-				wave.rightSelection == -1 ?
-					wavelength(wave.wsize, wave.sampleRate, wave.channels) :
-					wavelength(wave.rightSelection, wave.sampleRate, wave.channels),
-				wavelength(
-					(wave.rightSelection == -1 ? wave.wsize :
-						wave.rightSelection) -
-					(wave.leftSelection == -1 ? 0 :
-						wave.leftSelection),
-					wave.sampleRate, wave.channels),
-				wave.modificated ? "yes" : "no");
-	else
-		puts("wave is null");
+	size_t i, a, e;
+	Piece *p;
+
+	for (i = l < r ? piecefind(wave, l) : wave->npieces; i < wave->npieces &&
+			wave->piece[i].pos < r; ++i) {
+		p = wave->piece + i;
+		a = MAX(l, p->pos) - p->pos;
+		e = MIN(r, p->pos + p->len) - p->pos;
+		/* coarse spans of a few blocks or more keep to whole blocks, so
+		 * no samples have to be read for them */
+		a += p->off;
+		e += p->off;
+		if (coarse && e - a >= 4 * PEAKBLK) {
+			a = (a + PEAKBLK - 1) / PEAKBLK * PEAKBLK;
+			e = e == p->buf->len ? e : e / PEAKBLK * PEAKBLK;
+		}
+		bufpeaks(p->buf, a, e, s);
+	}
 }
 
 static void
-printwavelist(Wave *waves, size_t waven)
+waverange(Wave *wave, size_t *l, size_t *r)
 {
-	Wave *ws = waves--;
-	while ((++waves - ws) < waven)
-		printf("[%ld]: \"%s\"\n",
-			waves - ws, (*waves).name);
+	size_t ch = MAX(wave->channels, 1);
+	*l = wave->leftSelection == (size_t)-1 ? 0 : wave->leftSelection;
+	*r = wave->rightSelection == (size_t)-1 ? wave->wsize : wave->rightSelection;
+	*r = MIN(*r, wave->wsize);
+	*l = MIN(*l, *r);
+	/* the channels of a planar wave are cut in the same places */
+	if (wave->planar) {
+		*l -= *l % ch;
+		*r -= *r % ch;
+	}
 }
 
-static Wave             /* 1 is bigger than 0, so 1 is big endian ;) */
-readf32(char *filename, char endianness, int sampleRate, int channels)
+static void
+waveread(Wave *wave, size_t pos, size_t n, float *dst)
 {
-	FILE *fp = NULL; /* wave *file */
-	int ch[4]; /* temporary buffer */
-	Wave ret;
+	wavestride(wave, pos, n, dst, 0);
+}
 
-	union {
-		float f;
-		char carr[4];
-	} fcarr; /* union that converts 4 chars from file to float */
+static void
+wavesilence(Wave *wave, char *l)
+{
+	size_t ch = MAX(wave->channels, 1), pos, r, n, c;
+	long len;
+	Piece p;
+	if ((len = strtol(l, NULL, 10)) <= 0)
+		return;
+	wavesnap(wave);
+	waverange(wave, &pos, &r);
+	n = len * wave->channels * (l[strlen(l) - 1] == 's' ? wave->sampleRate : 1);
+	p.off = 0;
+	/* no source, reads back zeroes; a buffer for each channel of a
+	 * planar wave, the last first so the others keep their positions */
+	for (c = wave->planar ? ch : 1; c-- > 0; ) {
+		p.len = wave->planar ? n / ch : n;
+		p.buf = bufnew(p.len, -1, 0, 0);
+		p.buf->prec = wave->prec;
+		pieceinsert(wave, piecesplit(wave, waveplane(wave, c, pos)), &p, 1);
+	}
+	wave->wsize += n;
+	wave->leftSelection = pos;
+	wave->rightSelection = pos + n;
+	wave->modificated = 1;
+}
 
-	if ((fp = fopen(filename, "r")) == NULL)
-		die("unable to open %s:", filename); /* opening file, temporary
-												dies; TODO */
+/* room for a wave at the end of the table, which grows geometrically */
+static Wave *
+waveslot(Wave **waves, size_t *waven)
+{
+	if (*waven == wavecap) {
+		wavecap = MAX(2 * wavecap, 4);
+		if ((*waves = realloc(*waves, sizeof(Wave) * wavecap)) == NULL)
+			die("realloc:");
+	}
+	return &(*waves)[(*waven)++];
+}
 
-	ret.name = filename;
-	ret.wave = malloc(0);
-	ret.wsize = ret.modificated = 0;
-	ret.sampleRate = sampleRate ? sampleRate : 48000;
-	ret.channels = channels ? channels : 2;
-	ret.leftSelection = ret.rightSelection = -1;
+static void
+wavesnap(Wave *wave)
+{
+	histfree(wave->redo, wave->nredo);
+	wave->nredo = 0;
+	if ((wave->undo = realloc(wave->undo,
+					sizeof(Snap) * (wave->nundo + 1))) == NULL)
+		die("realloc:");
+	/* the snapshot only holds references: the buffers it shares with the
+	 * wave are copied on write, chunk by chunk, by the edit that follows */
+	snaptake(&wave->undo[wave->nundo++], wave);
+}
 
-	while ((ch[endianness ? 3 : 0] = fgetc(fp), /* this code will work only on | ? 0 : 3] = | */
-			ch[endianness ? 2 : 1] = fgetc(fp), /* little endian architectures | ? 1 : 2] = | */
-			ch[endianness ? 1 : 2] = fgetc(fp), /* like x86, on big endian you | ? 2 : 1] = | */
-			ch[endianness ? 0 : 3] = fgetc(fp)) != -1) { /* must reverse array | ? 3 : 0] = | */
-		fcarr.carr[0] = (int)ch[0]; fcarr.carr[1] = (int)ch[1];
-		fcarr.carr[2] = (int)ch[2]; fcarr.carr[3] = (int)ch[3];
-		ret.wave = realloc(ret.wave, sizeof(float) * ++(ret.wsize));
-		(ret.wave)[ret.wsize - 1] = fcarr.f;
+static void
+waveunpin(Pin *pin)
+{
+	if (pin->tile != NULL) {
+		if (pin->write)
+			bufpack(pin->b, pin->c, pin->off, pin->n, pin->tile);
+		pthread_mutex_lock(&storelock);
+		if (tiles.n == tiles.size && (tiles.t = realloc(tiles.t,
+						sizeof(*tiles.t) * (tiles.size = 2 * tiles.size + 4))) == NULL)
+			die("realloc:");
+		tiles.t[tiles.n++] = pin->tile;
+		pthread_mutex_unlock(&storelock);
 	}
+	bufunpin(pin->b, pin->ci);
+}
 
-	fclose(fp);
+/* n samples from pos in the interleaved order of the channels moved to or
+ * from p, whatever order the wave keeps them in */
+static void
+wavestride(Wave *wave, size_t pos, size_t n, float *p, char write)
+{
+	size_t ch = MAX(wave->channels, 1), c, k, f, m, got, i;
+	float *q;
+	Pin pin;
 
-	return ret;
+	if (!wave->planar) {
+		if (write)
+			waveput(wave, pos, n, p);
+		else
+			waveget(wave, pos, n, p);
+		return;
+	}
+	for (c = 0; c < ch; ++c) {
+		/* sample k of p is the first of channel c */
+		if ((k = (c + ch - pos % ch) % ch) >= n)
+			continue;
+		f = waveplane(wave, c, pos + k);
+		for (m = (n - k + ch - 1) / ch; m; f += got, m -= got) {
+			got = m;
+			q = wavepin(wave, f, &got, write, &pin);
+			if (write)
+				for (i = 0; i < got; ++i, k += ch)
+					q[i] = p[k];
+			else
+				for (i = 0; i < got; ++i, k += ch)
+					p[k] = q[i];
+			waveunpin(&pin);
+		}
+	}
 }
 
 static void
-savef32(char *filename, Wave wave, char endianness)
+waveundo(Wave *wave)
 {
-	FILE *fp = NULL; /* wave *file */
-	union {
-		char carr[4];
-		float f;
-	} carrf; /* union that converts float to 4 chars array */
+	Snap cur;
+	if (!wave->nundo) {
+		puts("err: nothing to undo");
+		return;
+	}
+	snaptake(&cur, wave);
+	cur.cost = wave->undo[wave->nundo - 1].cost;
+	snaprestore(&wave->undo[--wave->nundo], wave);
+	if ((wave->redo = realloc(wave->redo,
+					sizeof(Snap) * (wave->nredo + 1))) == NULL)
+		die("realloc:");
+	wave->redo[wave->nredo++] = cur;
+}
 
-	if ((fp = fopen(filename, "w")) == NULL) {
-		die("unable to open %s:", filename);
-	} /* opening file */
+static void
+wavevolume(Wave *wave, char *l)
+{
+	Op op;
+	char *e;
 
-	while (wave.wsize--) {
-		carrf.f = *(wave.wave++);
-		fprintf(fp, "%c%c%c%c",
-				carrf.carr[endianness ? 3 : 0], carrf.carr[endianness ? 2 : 1],
-				carrf.carr[endianness ? 1 : 2], carrf.carr[endianness ? 0 : 3]);
+	op.g = strtof(l, &e);
+	if (*e == '\0')
+		op.limit = LimitNone;
+	else if (!strcmp(e, "/hard"))
+		op.limit = LimitHard;
+	else if (!strcmp(e, "/soft"))
+		op.limit = LimitSoft;
+	else {
+		printf("err: unknown limiter: %s\n", e);
+		return;
 	}
 
-	fclose(fp);
+	/* only recorded, waveapply() runs it with the ones around it */
+	wavesnap(wave);
+	waverange(wave, &op.l, &op.r);
+	if ((wave->ops = realloc(wave->ops, sizeof(Op) * (wave->nops + 1))) == NULL)
+		die("realloc:");
+	wave->ops[wave->nops++] = op;
+	wave->modificated = 1;
 }
 
 static void
-selectwave(Wave *waves, size_t waven, int *selwav, char *l)
+wavevolumekern(void *arg, float *p, size_t n)
 {
-	*selwav = strtol(++l, NULL, 10);
-	if (*selwav >= waven)
-		printf("wave [%d] doesn't exist, unselecting\n",
-				*selwav), *selwav = -1;
+	Gain *g = arg;
+	float peak = 0;
+	size_t clipped = 0;
+	gain(p, n, g->g, g->limit, &peak, &clipped);
+	pthread_mutex_lock(&g->lock);
+	g->peak = MAX(g->peak, peak);
+	g->clipped += clipped;
+	pthread_mutex_unlock(&g->lock);
+}
+
+static float
+wavelength(size_t wsize, int sampleRate, int channels)
+{
+	return (float)wsize / sampleRate / channels;
 }
 
 static void
-shell(Wave **waves, size_t *waven)
+wavereverse(Wave *wave)
 {
-	char *l; size_t lsiz = 0, lsizr = 0;
-	int selwav = -1;
+	size_t ch = MAX(wave->channels, 1), l, r, c;
+	MapJob j;
+	wavesnap(wave);
+	waverange(wave, &l, &r);
+	j.wave = wave;
+	/* whole frames are reversed so the channels keep their order, the
+	 * run of each channel of a planar wave on its own */
+	j.ch = wave->planar || (r - l) % ch || ch > TILE ? 1 : ch;
+	for (c = 0; c < (wave->planar ? ch : 1); ++c) {
+		j.l = waveplane(wave, c, l);
+		j.r = waveplane(wave, c, r);
+		waveprivate(wave, j.l, j.r);
+		/* tile i and its mirror are swapped by one task, so tasks
+		 * never touch the same samples and can run in any order */
+		poolrun(wavereversetile, &j, ((j.r - j.l) / j.ch / 2 +
+					TILE / j.ch - 1) / (TILE / j.ch));
+	}
+	wave->modificated = 1;
+}
 
-	l = malloc(lsiz);
-	printf(":");
-	while ((lsizr = getline(&l, &lsiz, stdin)) > 0) {
-		if (l[lsizr - 1] == '\n') l[lsizr - 1] = '\0';
-		switch (*l) {
-		case '#': /* comment */
+static void
+wavereversetile(void *arg, size_t i)
+{
+	MapJob *j = arg;
+	float front[TILE], back[TILE], t;
+	size_t ch = j->ch, tf = TILE / ch, a, b, c, k;
+	size_t n = MIN(tf, (j->r - j->l) / ch / 2 - tf * i); /* frames */
+	size_t l = j->l + ch * tf * i, r = j->r - ch * tf * i;
+
+	waveget(j->wave, l, ch * n, front);
+	waveget(j->wave, r - ch * n, ch * n, back);
+	for (k = 0; k < n / 2; ++k) {
+		for (c = 0; c < ch; ++c) {
+			a = ch * k + c;
+			b = ch * (n - 1 - k) + c;
+			t = front[a], front[a] = front[b], front[b] = t;
+			t = back[a], back[a] = back[b], back[b] = t;
+		}
+	}
+	waveput(j->wave, l, ch * n, back);
+	waveput(j->wave, r - ch * n, ch * n, front);
+}
+
+static void
+wavewrite(Wave *wave, size_t pos, size_t n, const float *src)
+{
+	wavestride(wave, pos, n, (float *)src, 1);
+}
+
+#ifdef XVIEW
+/* pending edits wait until the view is to draw samples they cover */
+static void
+viewapply(Wave *waves, size_t waven, Wave *wave)
+{
+	size_t ch, frames, a, e, i;
+
+	if (wave == NULL || !wave->nops)
+		return;
+	ch = MAX(wave->channels, 1);
+	frames = wave->wsize / ch;
+	a = MIN((size_t)view.off, frames) * ch;
+	e = MIN((size_t)(view.off + view.spp * view.w) + 1, frames) * ch;
+	for (i = 0; i < wave->nops; ++i) {
+		if (wave->ops[i].l < e && a < wave->ops[i].r) {
+			applywave(waves, waven, wave);
+			return;
+		}
+	}
+}
+
+static void
+viewdraw(Wave *wave, int flags)
+{
+	size_t x, a, e, l = 0, r = 0, ch = 1, frames = 0, x0 = 0, loaded = 0;
+	int y0, y1, mid, half, dirty, run = 0;
+	PeakSum s;
+	Peak c;
+	char sel, bar[sizeof(view.bar)];
+
+	if (wave != NULL) {
+		ch = MAX(wave->channels, 1);
+		frames = wave->wsize / ch;
+		waverange(wave, &l, &r);
+		loaded = viewloaded(wave);
+	}
+	mid = view.bh + (view.h - view.bh) / 2;
+	half = (view.h - view.bh) / 2;
+	/* only columns whose peaks or selection changed are drawn again */
+	for (x = 0; x <= (size_t)view.w; ++x) {
+		dirty = 0;
+		if (x < (size_t)view.w) {
+			a = MIN((size_t)(view.off + view.spp * x), frames) * ch;
+			e = MIN((size_t)(view.off + view.spp * (x + 1)), frames) * ch;
+			e = a < e || a == frames * ch ? e : a + ch;
+			sel = l < r ? a < r && l < e : a <= l && l < e;
+			c = view.col[x];
+			if (flags & ViewPeaks) {
+				if (a < e && e <= loaded)
+					wavepeaks(wave, a, e, &s, 1);
+				else
+					s.min = 1, s.max = -1; /* nothing there yet */
+				c.min = s.min;
+				c.max = s.max;
+			}
+			dirty = flags & ViewAll || sel != view.colsel[x] ||
+				c.min != view.col[x].min || c.max != view.col[x].max;
+		}
+		if (dirty) {
+			view.col[x] = c;
+			view.colsel[x] = sel;
+			drw_setscheme(view.drw, view.scheme[sel ? SchemeSel : SchemeNorm]);
+			drw_rect(view.drw, x, view.bh, 1, view.h - view.bh, 1, 1);
+			if (c.min <= c.max) {
+				y0 = mid - MIN(c.max, 1) * half;
+				y1 = mid - MAX(c.min, -1) * half;
+				drw_rect(view.drw, x, y0, 1, MAX(y1 - y0, 1), 1, 0);
+			}
+			if (!run)
+				x0 = x;
+			run = 64; /* runs closer than this are copied as one */
+		} else if (run && (!--run || x == (size_t)view.w)) {
+			drw_map(view.drw, view.win, x0, view.bh, x - x0, view.h - view.bh);
+			run = 0;
+		}
+	}
+
+	if (wave == NULL)
+		snprintf(bar, sizeof(bar), "no wave selected");
+	else if (wave->load != NULL)
+		snprintf(bar, sizeof(bar), "%s  loading %d%%", wave->name,
+				loadprogress(wave->load));
+	else
+		snprintf(bar, sizeof(bar), "%s  %.3fs-%.3fs  %.2f frames/px",
+				wave->name, view.off / wave->sampleRate,
+				MIN(view.off + view.spp * view.w, frames) / wave->sampleRate,
+				view.spp);
+	if (flags & ViewAll || strcmp(bar, view.bar)) {
+		strcpy(view.bar, bar);
+		drw_setscheme(view.drw, view.scheme[SchemeNorm]);
+		drw_text(view.drw, 0, 0, view.w, view.bh, view.bh / 2, bar, 0);
+		drw_map(view.drw, view.win, 0, 0, view.w, view.bh);
+	}
+}
+
+/* samples at the start of the wave its loader has scanned, the part
+ * drawn without waiting for the scan of the rest */
+static size_t
+viewloaded(Wave *wave)
+{
+	Loader *ld = wave->load;
+	size_t done;
+
+	if (ld == NULL)
+		return wave->wsize;
+	done = __atomic_load_n(&ld->done, __ATOMIC_RELAXED);
+	if (done == ld->b->nchunks)
+		return wave->wsize;
+	if (wave->planar || !wave->npieces || wave->piece[0].buf != ld->b ||
+			wave->piece[0].off)
+		return 0;
+	return MIN(wave->piece[0].len, CHUNK * done);
+}
+
+static int
+viewevent(XEvent *ev, Wave *wave)
+{
+	double frames, fit, f;
+	size_t ch;
+
+	switch (ev->type) {
+	case ClientMessage: /* closed: the shell carries on, v shows it again */
+		if ((Atom)ev->xclient.data.l[0] == view.wmdelete)
+			XUnmapWindow(view.dpy, view.win);
+		return 0;
+	case ConfigureNotify:
+		if (ev->xconfigure.width == view.w && ev->xconfigure.height == view.h)
+			return 0;
+		view.spp *= (double)view.w / MAX(ev->xconfigure.width, 1);
+		viewresize(ev->xconfigure.width, ev->xconfigure.height);
+		return ViewPeaks | ViewAll;
+	case Expose:
+		if (ev->xexpose.count == 0)
+			drw_map(view.drw, view.win, 0, 0, view.w, view.h);
+		return 0;
+	}
+	if (wave == NULL)
+		return 0;
+	ch = MAX(wave->channels, 1);
+	frames = wave->wsize / ch;
+	fit = MAX(frames, 1) / view.w;
+	if (ev->type == ButtonPress) {
+		f = view.off + view.spp * ev->xbutton.x;
+		switch (ev->xbutton.button) {
+		case Button1:
+			wave->leftSelection = MIN(f, frames) * ch;
+			return 0;
+		case Button3:
+			wave->rightSelection = MIN(f, frames) * ch;
+			return 0;
+		case Button4: /* zoom in and out around the pointer */
+		case Button5:
+			view.spp *= ev->xbutton.button == Button4 ? 0.8 : 1.25;
+			view.spp = MIN(MAX(view.spp, 1.0 / 16), MAX(fit, 1));
+			view.off = f - view.spp * ev->xbutton.x;
 			break;
-		case ':': /* command */
-			docommand(waves, waven, &selwav, l + 1);
+		default:
+			return 0;
+		}
+	} else if (ev->type == KeyPress) {
+		switch (XLookupKeysym(&ev->xkey, 0)) {
+		case XK_Left:
+			view.off -= view.spp * view.w / 4;
+			break;
+		case XK_Right:
+			view.off += view.spp * view.w / 4;
+			break;
+		case XK_Home:
+			view.off = 0;
+			view.spp = fit;
 			break;
-		case 'e': /* edit */
-			editwave(waves, waven, *(l + 1) == ' ' ?
-					l + 2 : l + 1); break;
-		case 'i': /* info */
-			printwaveinfo((*waves)[selwav]); break;
-		case 'l': /* list */
-			printwavelist(*waves, *waven); break;
-		case 'n': /* new */
-			newwave(waves, waven, *(l + 1) == ' ' ?
-					l + 2 : l + 1); break;
-		case 'p': /* play wave */
-			playwave((*waves)[selwav]); break;
-		case 's': /* select wave */
-			selectwave(*waves, *waven, &selwav, l); break;
-		case 'w': /* write */
-			writewave((*waves)[selwav], *(l + 1) == ' ' ?
-					l + 2 : l + 1); break;
-		case 'q': /* quit */
-			goto stop; break;
-		case 'L': /* left selection change */
-			changewavselection(&((*waves)[selwav]), 0, l + 1); break;
-		case 'R': /* left selection change */
-			changewavselection(&((*waves)[selwav]), 1, l + 1); break;
 		default:
-			puts("?"); break;
+			return 0;
 		}
-		if (selwav != -1)
-			printf("[wave: %d]:", selwav);
-		else
-			printf(":");
+	} else {
+		return 0;
 	}
+	view.off = MAX(MIN(view.off, frames - view.spp * view.w), 0);
+	return ViewPeaks;
+}
 
-	puts("");
-	stop:
-	free(l);
+static void
+viewfree(void)
+{
+	size_t i;
+	for (i = 0; i < SchemeLast; ++i)
+		free(view.scheme[i]);
+	drw_fontset_free(view.drw->fonts);
+	drw_free(view.drw);
+	XDestroyWindow(view.dpy, view.win);
+	XCloseDisplay(view.dpy);
+	free(view.col);
+	free(view.colsel);
 }
 
 static void
-wavedump(Wave wave)
+viewinit(void)
 {
-	float *wptr = wave.wave + 1;
-	while (wave.wsize--)
-		printf("[%6ld]: %f\n",
-				wave.wave - wptr, *(wave.wave++));
+	XSetWindowAttributes wa;
+	int screen;
+	Window root;
+	size_t i;
+
+	if (!(view.dpy = XOpenDisplay(NULL)))
+		die("med: cannot open display");
+	screen = DefaultScreen(view.dpy);
+	root = RootWindow(view.dpy, screen);
+	view.drw = drw_create(view.dpy, screen, root, viewwidth, viewheight);
+	if (!drw_fontset_create(view.drw, fonts, LENGTH(fonts)))
+		die("no fonts could be loaded");
+	view.bh = view.drw->fonts->h + 2;
+	for (i = 0; i < SchemeLast; ++i)
+		view.scheme[i] = drw_scm_create(view.drw, colors[i], 2);
+	wa.background_pixel = view.scheme[SchemeNorm][ColBg].pixel;
+	wa.event_mask = ExposureMask | KeyPressMask | ButtonPressMask |
+		StructureNotifyMask;
+	view.win = XCreateWindow(view.dpy, root, 0, 0, viewwidth, viewheight, 0,
+			DefaultDepth(view.dpy, screen), InputOutput,
+			DefaultVisual(view.dpy, screen), CWBackPixel | CWEventMask, &wa);
+	XStoreName(view.dpy, view.win, "med");
+	view.wmdelete = XInternAtom(view.dpy, "WM_DELETE_WINDOW", False);
+	XSetWMProtocols(view.dpy, view.win, &view.wmdelete, 1);
+	viewresize(viewwidth, viewheight);
+	view.spp = 1;
+	XMapWindow(view.dpy, view.win);
+
+	/* lines are read a byte at a time, so no line waits in stdio's
+	 * buffer while poll(2) waits for the next one */
+	setvbuf(stdin, NULL, _IONBF, 0);
 }
 
 static void
-wavevolume(Wave *wave, char *l)
+viewresize(int w, int h)
 {
-	int iter = wave->leftSelection == -1 ? -1 : wave->leftSelection - 1;
-	float voldiff;
-	voldiff = strtof(l, NULL);
-	while (++iter < (wave->rightSelection == -1 ? wave->wsize : wave->rightSelection))
-		wave->wave[iter] *= voldiff;
+	view.w = MAX(w, 1);
+	view.h = MAX(h, view.bh + 2);
+	drw_resize(view.drw, view.w, view.h);
+	view.col = realloc(view.col, sizeof(*view.col) * view.w);
+	view.colsel = realloc(view.colsel, view.w);
+	if (view.col == NULL || view.colsel == NULL)
+		die("realloc:");
 }
 
-static float
-wavelength(size_t wsize, int sampleRate, int channels)
+static void
+viewwait(Wave *waves, size_t waven, int selwav)
 {
-	return (float)wsize / sampleRate / channels;
+	struct pollfd pfd[2];
+	Wave *wave = selwav < 0 ? NULL : &waves[selwav];
+	XEvent ev;
+	int flags = ViewPeaks; /* the line before may have changed anything */
+
+	if (selwav != view.sel) {
+		view.sel = selwav;
+		view.off = 0;
+		view.spp = wave == NULL ? 1 :
+			MAX(wave->wsize / MAX(wave->channels, 1), 1) / (double)view.w;
+		flags |= ViewAll;
+	}
+	pfd[0].fd = STDIN_FILENO;
+	pfd[1].fd = ConnectionNumber(view.dpy);
+	pfd[0].events = pfd[1].events = POLLIN;
+	fflush(stdout);
+	/* lines already waiting go first, so a pasted or piped run of edits
+	 * is drawn, and its gains applied, once after the last of them */
+	flags |= view.flags;
+	if (poll(pfd, 1, 0) > 0) {
+		view.flags = flags;
+		return;
+	}
+	view.flags = 0;
+	for (;;) {
+		/* events are drained before drawing, so a burst of zoom steps
+		 * costs one redraw */
+		while (XPending(view.dpy)) {
+			XNextEvent(view.dpy, &ev);
+			flags |= viewevent(&ev, wave);
+		}
+		if (flags & ViewPeaks)
+			viewapply(waves, waven, wave);
+		viewdraw(wave, flags);
+		flags = 0;
+		if (XPending(view.dpy)) /* queued while drawing */
+			continue;
+		/* a wave being loaded is drawn again as its loader gets on,
+		 * and once more as it is done */
+		if (poll(pfd, 2, wave && wave->load ? VIEWPOLL : -1) < 0 &&
+				errno != EINTR)
+			die("poll:");
+		if (pfd[0].revents)
+			return;
+		if (wave && wave->load) {
+			loadfree(wave, LoadPoll);
+			flags |= ViewPeaks;
+		}
+	}
 }
+#endif
 
 static void
-wavereverse(Wave *wave)
+writeall(int fd, const void *buf, size_t n, char *filename)
+{
+	ssize_t w;
+	COUNT(writebytes, n);
+	while (n) {
+		if ((w = write(fd, buf, n)) < 0) {
+			if (errno == EINTR)
+				continue;
+			die("unable to write %s:", filename);
+		}
+		buf = (const char *)buf + w;
+		n -= w;
+	}
+}
+
+/* the stats so far as json lines, one object per command with the
+ * columns of :stats; rssgrowth is how many kB the peak resident set
+ * grew by over the command, not the resident set after it */
+static void
+writestats(char *filename)
 {
-	size_t beginning = wave->leftSelection == -1 ? 0 : wave->leftSelection - 1,
-		   ending = wave->rightSelection == -1 ? wave->wsize : wave->rightSelection;
-	size_t bufsiz = ending - beginning;
-	float *wavebuf = malloc(sizeof(float) * bufsiz);
-	size_t iter = -1;
-	while (++iter < bufsiz)
-		wavebuf[iter] = wave->wave[beginning + iter];
-	iter = -1; ++ending;
-	while (ending-- > beginning)
-		wave->wave[(iter + beginning) - 1] = wavebuf[bufsiz - ++iter];
-	free(wavebuf);
+	FILE *fp;
+	Stat *s;
+	char *c;
+
+	if (*filename == '\0' || (fp = fopen(filename, "w")) == NULL) {
+		printf("err: unable to write %s\n", filename);
+		return;
+	}
+	for (s = stats; s < stats + nstats; ++s) {
+		fputs("{\"cmd\":\"", fp);
+		for (c = s->cmd; *c; ++c)
+			if (*c == '"' || *c == '\\')
+				fprintf(fp, "\\%c", *c);
+			else if ((unsigned char)*c < 0x20)
+				fprintf(fp, "\\u%04x", *c);
+			else
+				fputc(*c, fp);
+		fprintf(fp, "\",\"wall\":%.6f,\"cpu\":%.6f,\"touched\":%lu,"
+				"\"mbps\":%.1f,\"read\":%lu,\"written\":%lu,"
+				"\"faults\":%ld,\"allocs\":%lu,\"rssgrowth\":%ld}\n",
+				s->wall, s->cpu, (unsigned long)s->touched,
+				s->wall > 0 ? s->touched / s->wall / 1e6 : 0,
+				(unsigned long)s->read, (unsigned long)s->written,
+				s->faults, (unsigned long)s->allocs, s->rss);
+	}
+	if (fclose(fp))
+		printf("err: unable to write %s\n", filename);
 }
 
 static void
-writewave(Wave wave, char *name)
+writewave(Wave wave, char *l)
 {
-	savef32((*name == 0 ? wave.name : name), wave, 0);
+	const Codec *codec = wave.codec;
+	char *fmt = NULL, le[8];
+	size_t len;
+
+	if (*l == '/') { /* w/format name */
+		fmt = ++l;
+		l += strcspn(l, " ");
+		if (*l)
+			*l++ = '\0';
+		if ((codec = codecfind(fmt)) == NULL) {
+			printf("err: unknown wave format: %s\n", fmt);
+			return;
+		}
+	} else if (*l == ' ') {
+		++l;
+	}
+	/* waves written back keep their container, other files get a wav
+	 * header when they are named .wav and are packed when named .med;
+	 * wav files are always little endian, packed ones keep the floats */
+	if (*l == '\0')
+		l = wave.name;
+	else if ((len = strlen(l)) >= 4 && !strcmp(l + len - 4, ".wav"))
+		wave.head = Riff;
+	else
+		wave.head = len >= 4 && !strcmp(l + len - 4, ".med") ? Pack : Raw;
+	if (wave.head == Pack) {
+		if (fmt != NULL && (codec->type != CodecFloat || codec->size != 4)) {
+			printf("err: packed waves keep floats: %s\n", fmt);
+			return;
+		}
+		codec = codecfind("f32le");
+	}
+	if (wave.head == Riff && codec->endianness) {
+		snprintf(le, sizeof(le), "%.*sle", (int)strlen(codec->name) - 2,
+				codec->name);
+		codec = codecfind(le);
+	}
+	savewave(l, wave, codec, 1);
 }
 
 static void
 usage(void)
 {
-	die("usage: %s [-v] [-f waveformat] wave", argv0);
+	die("usage: %s [-v] [-f waveformat] [-s samplerate] [-c channels] "
+			"[-j threads] [-m budget] [-p precision] [-P] wave", argv0);
 }
 
 int
@@ -354,6 +3879,7 @@ main(int argc, char *argv[])
 	Wave *waves;            /* this is a waves array */
 	size_t waven = 0;       /* and the size of array. */
 	int argx = -1;          /* iterator for files (argv) */
+	size_t i;               /* and for the waves read */
 
 	ARGBEGIN {
 	case 'v':
@@ -364,26 +3890,57 @@ main(int argc, char *argv[])
 		sampleRate = (int)strtol(ARGF(), NULL, 10); break;
 	case 'c':
 		channels = (int)strtol(ARGF(), NULL, 10); break;
+	case 'j':
+		nthreads = (int)strtol(ARGF(), NULL, 10); break;
+	case 'm':
+		membudget = strtoul(ARGF(), NULL, 10) << 20; break;
+	case 'p':
+		if ((defprec = precfind(ARGF())) < 0)
+			die("unknown precision [check -p parameter]");
+		break;
+	case 'P':
+		defplanar = 1; break;
 	default:
 		usage(); break;
 	} ARGEND
 
-	waves = malloc(0);
+	dspinit();
+	codecinit();
+	if ((defcodec = codecfind(format)) == NULL)
+		die("unknown wave format [check -f parameter]");
+	defrate = sampleRate;
+	defchannels = channels;
+	if (nthreads <= 0)
+		nthreads = MAX(sysconf(_SC_NPROCESSORS_ONLN), 1);
+	poolinit(nthreads);
+	if (membudget)
+		membudget = MAX(membudget, 2 * sizeof(float) * CHUNK);
+	waves = NULL;
 
-	while (++argx < argc) {
-		waves = realloc(waves, sizeof(Wave) * ++waven);
-		if (!strcmp(format, "f32le"))
-			waves[argx] = readf32(argv[argx], 0, sampleRate, channels);
-		else if (!strcmp(format, "f32be"))
-			waves[argx] = readf32(argv[argx], 1, sampleRate, channels);
-		else
-			die("unknown wave format [check -f parameter]");
+	/* the waves are read in by the loader threads at once, iodepth of
+	 * them at a time; a wave that fails to open is left out */
+	while (++argx < argc)
+		if (readwave(waveslot(&waves, &waven), argv[argx], defcodec,
+					sampleRate, channels, defprec, 1) < 0)
+			--waven;
+	for (i = 0; i < waven; ++i) {
+		loadfree(&waves[i], LoadWait);
+		if (defplanar)
+			wavelayout(&waves[i], 1, defprec);
 	}
 
+#ifdef XVIEW
+	viewinit();
+#endif
 	shell(&waves, &waven);
+#ifdef XVIEW
+	viewfree();
+#endif
 
 	argx = -1;
 	while (++argx < waven)
-		free(waves[argx].wave);
+		freewave(&waves[argx]);
+	freewave(&clip);
 	free(waves);
+	free(stats);
 }
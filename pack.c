@@ -0,0 +1,257 @@
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pack.h"
+
+/*
+ * a block is a mode byte and the samples, either as they are or as a
+ * bit stream with each channel in turn: a channel whose samples are all
+ * integers times 2^-shift (anything converted from a fixed point format)
+ * is coded as those integers, others as their bits mapped to integers
+ * in the same order; a fixed polynomial predictor of order 0 to 4 is
+ * taken out and the residuals are rice coded in partitions, as in flac
+ */
+
+enum { PackVerbatim, PackCoded }; /* block modes */
+enum { MapInt, MapBits };         /* channel mappings */
+
+#define RICEPART 1024 /* residuals sharing a rice parameter */
+#define RICEMAXK 31
+#define RICEESC  24   /* quotients this long are escaped, */
+#define ESCBITS  40   /* the residual follows in full */
+
+typedef struct {
+	unsigned char *p;
+	uint64_t acc;
+	int n; /* bits in acc not written yet */
+} Put;
+
+typedef struct {
+	const unsigned char *p;
+	size_t i, size;
+	uint64_t acc;
+	int n;   /* bits in acc not read yet */
+	int pad; /* bytes of acc past the end */
+} Get;
+
+static void
+putbits(Put *b, uint64_t v, int n) /* n <= 32 */
+{
+	b->acc = b->acc << n | (v & (((uint64_t)1 << n) - 1));
+	for (b->n += n; b->n >= 8; b->n -= 8)
+		*b->p++ = b->acc >> (b->n - 8);
+}
+
+static void
+putrice(Put *b, uint64_t v, int k)
+{
+	uint64_t q = v >> k;
+	if (q >= RICEESC) {
+		putbits(b, ((uint64_t)1 << RICEESC) - 1, RICEESC);
+		putbits(b, v >> (ESCBITS / 2), ESCBITS / 2);
+		putbits(b, v, ESCBITS / 2);
+	} else {
+		putbits(b, ((uint64_t)1 << (q + 1)) - 2, q + 1); /* q ones, a zero */
+		putbits(b, v, k);
+	}
+}
+
+static void
+refill(Get *b)
+{
+	for (; b->n <= 56; b->n += 8)
+		if (b->i < b->size)
+			b->acc = b->acc << 8 | b->p[b->i++];
+		else
+			b->acc <<= 8, ++b->pad;
+}
+
+static uint64_t
+getbits(Get *b, int n) /* n <= 32 */
+{
+	if (b->n < n)
+		refill(b);
+	b->n -= n;
+	return b->acc >> b->n & (((uint64_t)1 << n) - 1);
+}
+
+static uint64_t
+getrice(Get *b, int k)
+{
+	uint64_t top, q, v;
+	refill(b);
+	top = ~(b->acc << (64 - b->n));
+	q = top ? __builtin_clzll(top) : 64;
+	if (q >= RICEESC) {
+		b->n -= RICEESC;
+		v = getbits(b, ESCBITS / 2) << (ESCBITS / 2);
+		return v | getbits(b, ESCBITS / 2);
+	}
+	b->n -= q + 1;
+	return q << k | getbits(b, k);
+}
+
+/* the smallest shift making every sample of the channel an integer
+ * that fits 32 bits, -1 if there is none; -0, infinities and nans are
+ * only kept by their bits */
+static int
+intshift(const float *src, size_t n, int channels, size_t c)
+{
+	union { float f; uint32_t u; } x;
+	int s = 0, e = -150, t, E;
+	uint32_t m;
+
+	for (; c < n; c += channels) {
+		x.f = src[c];
+		if (!(x.u & 0x7fffffff)) {
+			if (x.u)
+				return -1;
+			continue;
+		}
+		if ((E = x.u >> 23 & 0xff) == 0xff)
+			return -1;
+		m = x.u & 0x7fffff;
+		if (E) /* normal, else denormal with the exponent of 1 */
+			m |= 0x800000;
+		else
+			E = 1;
+		/* |x| = m * 2^(E - 150) < 2^(E - 126) */
+		t = 150 - E - __builtin_ctz(m);
+		s = t > s ? t : s;
+		e = E - 126 > e ? E - 126 : e;
+	}
+	return e + s <= 31 ? s : -1;
+}
+
+static int32_t
+tomap(float f, int map, double scale)
+{
+	union { float f; int32_t i; } x;
+	if (map == MapInt)
+		return (int32_t)(f * scale);
+	x.f = f;
+	return x.i < 0 ? x.i ^ 0x7fffffff : x.i;
+}
+
+static float
+frommap(int32_t v, int map, double scale)
+{
+	union { float f; int32_t i; } x;
+	if (map == MapInt)
+		return (float)(v * scale);
+	x.i = v < 0 ? v ^ 0x7fffffff : v;
+	return x.f;
+}
+
+size_t
+packencode(unsigned char *dst, const float *src, size_t n, int channels)
+{
+	union { float f; uint32_t u; } x;
+	uint64_t sum[5], z[RICEPART], zs;
+	int64_t d[5], last[5];
+	int c, map, shift, order, k;
+	double scale;
+	size_t i, a, j;
+	Put b = { dst + 1, 0, 0 };
+
+	*dst = PackCoded;
+	for (c = 0; c < channels && (size_t)c < n; ++c) {
+		/* the predictor leaving the least residual over the channel */
+		shift = intshift(src, n, channels, c);
+		map = shift < 0 ? MapBits : MapInt;
+		scale = ldexp(1, shift);
+		memset(sum, 0, sizeof(sum));
+		memset(last, 0, sizeof(last));
+		for (i = c; i < n; i += channels) {
+			sum[0] += llabs(d[0] = tomap(src[i], map, scale));
+			for (k = 1; k <= 4; ++k)
+				sum[k] += llabs(d[k] = d[k - 1] - last[k - 1]);
+			memcpy(last, d, sizeof(last));
+		}
+		for (order = 0, k = 1; k <= 4; ++k)
+			if (sum[k] < sum[order])
+				order = k;
+
+		putbits(&b, map, 1);
+		putbits(&b, order, 3);
+		putbits(&b, map == MapInt ? shift : 0, 8);
+		/* residuals in partitions with a rice parameter of their own */
+		memset(last, 0, sizeof(last));
+		for (i = c; i < n; ) {
+			for (a = 0; a < RICEPART && i < n; i += channels, ++a) {
+				d[0] = tomap(src[i], map, scale);
+				for (k = 1; k <= order; ++k)
+					d[k] = d[k - 1] - last[k - 1];
+				memcpy(last, d, sizeof(last));
+				z[a] = (uint64_t)d[order] << 1 ^ (uint64_t)(d[order] >> 63);
+			}
+			for (zs = 0, j = 0; j < a; ++j)
+				zs += z[j];
+			for (k = 0; k < RICEMAXK && (uint64_t)a << (k + 1) < zs; ++k)
+				;
+			putbits(&b, k, 5);
+			for (j = 0; j < a; ++j)
+				putrice(&b, z[j], k);
+			if ((size_t)(b.p - dst) > 4 * n)
+				goto verbatim;
+		}
+	}
+	if (b.n)
+		*b.p++ = b.acc << (8 - b.n);
+	if ((size_t)(b.p - dst) <= 4 * n)
+		return b.p - dst;
+
+verbatim: /* noise and other samples that do not get smaller */
+	*dst = PackVerbatim;
+	for (i = 0; i < n; ++i) {
+		x.f = src[i];
+		for (j = 0; j < 4; ++j)
+			dst[1 + 4 * i + j] = x.u >> 8 * j;
+	}
+	return 1 + 4 * n;
+}
+
+int
+packdecode(float *dst, size_t n, const unsigned char *src, size_t size,
+		int channels)
+{
+	union { float f; uint32_t u; } x;
+	uint64_t d[4], r; /* wrapping on broken blocks */
+	int c, map, order, k = 0, j;
+	double scale;
+	size_t i, m;
+	Get b = { src, 1, size, 0, 0, 0 };
+
+	if (size == 1 + 4 * n && *src == PackVerbatim) {
+		for (i = 0; i < n; ++i) {
+			for (x.u = 0, j = 0; j < 4; ++j)
+				x.u |= (uint32_t)src[1 + 4 * i + j] << 8 * j;
+			dst[i] = x.f;
+		}
+		return 0;
+	}
+	if (!size || *src != PackCoded)
+		return -1;
+	for (c = 0; c < channels && (size_t)c < n; ++c) {
+		map = getbits(&b, 1);
+		if ((order = getbits(&b, 3)) > 4)
+			return -1;
+		scale = ldexp(1, -(int)getbits(&b, 8));
+		memset(d, 0, sizeof(d));
+		for (i = c, m = 0; i < n; i += channels, ++m) {
+			if (m % RICEPART == 0)
+				k = getbits(&b, 5);
+			r = getrice(&b, k);
+			r = r >> 1 ^ -(r & 1);
+			for (j = order; j-- > 0; )
+				d[j] = r = r + d[j];
+			dst[i] = frommap((int32_t)r, map, scale);
+		}
+		if (b.n < 8 * b.pad) /* read past the end */
+			return -1;
+	}
+	return 0;
+}
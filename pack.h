@@ -0,0 +1,13 @@
+/* lossless compressed blocks of .med waves */
+
+#define PACKMAGIC "medpack1"
+#define PACKHDR   40        /* bytes of header before the first block */
+#define PACKBLK   (1 << 18) /* samples per block, a few seconds of audio */
+#define PACKMAX(n) (4 * (size_t)(n) + 16384) /* most bytes n samples take */
+
+/* n interleaved samples; blocks are coded on their own so any of them
+ * can be decoded without the others, packdecode() returns -1 for a
+ * broken block */
+size_t packencode(unsigned char *dst, const float *src, size_t n, int channels);
+int packdecode(float *dst, size_t n, const unsigned char *src, size_t size,
+		int channels);